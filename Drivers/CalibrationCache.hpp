@@ -0,0 +1,131 @@
+#pragma once
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+// SPI flash calibration of one controller, as read by Joycon::init_bt().
+struct CalibrationRecord {
+	char serial[32];
+
+	// factory data, fixed for the life of the controller:
+	uint8_t factory_sensor_cal[0x18];
+	uint8_t factory_stick_cal[0x12];
+	uint8_t sensor_model[0x6];
+	uint8_t stick_model[0x24];
+
+	// user data, can be rewritten by the console's calibration screen:
+	uint8_t user_stick_cal[0x16];
+	uint8_t user_sensor_cal[0x1A];
+};
+
+// Calibration of every controller seen before, keyed by serial number, so
+// reconnecting skips the factory SPI reads. The user calibration is small
+// and may have changed since, so it is always read again and doubles as the
+// probe that tells whether the record needs rewriting.
+// Records are fixed size behind a small header:
+//     "JCAL" | uint32 version | uint32 count | CalibrationRecord[count]
+class CalibrationCache {
+
+public:
+
+	explicit CalibrationCache(const std::string &path = "joycon-calibration.bin") : path(path) {}
+
+	bool load() {
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		FILE *file = fopen(this->path.c_str(), "rb");
+		if (!file) return false;
+
+		char magic[4];
+		uint32_t version = 0, count = 0;
+		bool ok = fread(magic, 4, 1, file) == 1 && memcmp(magic, "JCAL", 4) == 0 &&
+			fread(&version, 4, 1, file) == 1 && version == VERSION &&
+			fread(&count, 4, 1, file) == 1 && count < 4096;
+		if (ok) {
+			this->records.resize(count);
+			ok = count == 0 || fread(&this->records[0], sizeof(CalibrationRecord), count, file) == count;
+		}
+		fclose(file);
+
+		if (!ok) {
+			this->records.clear();
+		}
+		return ok;
+	}
+
+	// writes a new file and renames it over the old one, readers never see half a file:
+	bool save() {
+		std::lock_guard<std::mutex> lock(this->mutex);
+		if (!this->dirty) return true;
+
+		std::string temp = this->path + ".tmp";
+		FILE *file = fopen(temp.c_str(), "wb");
+		if (!file) return false;
+
+		uint32_t version = VERSION, count = (uint32_t)this->records.size();
+		bool ok = fwrite("JCAL", 4, 1, file) == 1 &&
+			fwrite(&version, 4, 1, file) == 1 &&
+			fwrite(&count, 4, 1, file) == 1 &&
+			(count == 0 || fwrite(&this->records[0], sizeof(CalibrationRecord), count, file) == count);
+		ok = fclose(file) == 0 && ok;
+
+		if (!ok || rename(temp.c_str(), this->path.c_str()) != 0) {
+			remove(temp.c_str());
+			return false;
+		}
+		this->dirty = false;
+		return true;
+	}
+
+	// copies the record for serial into record, false if there is none:
+	bool find(const wchar_t *serial, CalibrationRecord &record) {
+		char key[32];
+		makeKey(serial, key);
+
+		std::lock_guard<std::mutex> lock(this->mutex);
+		for (size_t i = 0; i < this->records.size(); ++i) {
+			if (strncmp(this->records[i].serial, key, sizeof(key)) == 0) {
+				record = this->records[i];
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// adds or replaces the record for serial:
+	void store(const wchar_t *serial, const CalibrationRecord &record) {
+		std::lock_guard<std::mutex> lock(this->mutex);
+
+		CalibrationRecord stored = record;
+		makeKey(serial, stored.serial);
+
+		this->dirty = true;
+		for (size_t i = 0; i < this->records.size(); ++i) {
+			if (strncmp(this->records[i].serial, stored.serial, sizeof(stored.serial)) == 0) {
+				this->records[i] = stored;
+				return;
+			}
+		}
+		this->records.push_back(stored);
+	}
+
+private:
+
+	static const uint32_t VERSION = 1;
+
+	std::string path;
+	std::vector<CalibrationRecord> records;
+	bool dirty = false;
+	std::mutex mutex;// init_bt() runs on one thread per controller
+
+	// serials are MAC addresses, plain ASCII:
+	static void makeKey(const wchar_t *serial, char key[32]) {
+		memset(key, 0, 32);
+		for (int i = 0; serial && serial[i] && i < 31; ++i) {
+			key[i] = (char)serial[i];
+		}
+	}
+};
@@ -0,0 +1,183 @@
+#pragma once
+#include <chrono>
+#include <math.h>
+
+// Orientation as a unit quaternion, w + xi + yj + zk.
+struct Quaternion {
+	float w = 1;
+	float x = 0;
+	float y = 0;
+	float z = 0;
+
+	void normalize() {
+		float n = 1.0f / sqrtf(w * w + x * x + y * y + z * z);
+		w *= n;
+		x *= n;
+		y *= n;
+		z *= n;
+	}
+};
+
+// Madgwick's gradient descent filter (IMU variant, no magnetometer).
+// beta trades gyro drift correction against accelerometer noise.
+struct MadgwickFilter {
+
+	Quaternion q;
+	float beta = 0.1f;
+
+	// gyro in rad/s, accel in any unit, dt in seconds:
+	void update(const float gyro[3], const float accel[3], float dt) {
+		float q0 = q.w, q1 = q.x, q2 = q.y, q3 = q.z;
+		float gx = gyro[0], gy = gyro[1], gz = gyro[2];
+		float ax = accel[0], ay = accel[1], az = accel[2];
+
+		// rate of change from the gyro:
+		float qDot0 = 0.5f * (-q1 * gx - q2 * gy - q3 * gz);
+		float qDot1 = 0.5f * (q0 * gx + q2 * gz - q3 * gy);
+		float qDot2 = 0.5f * (q0 * gy - q1 * gz + q3 * gx);
+		float qDot3 = 0.5f * (q0 * gz + q1 * gy - q2 * gx);
+
+		// gradient step towards gravity, skipped while in free fall:
+		float aa = ax * ax + ay * ay + az * az;
+		if (aa > 0.0f) {
+			float n = 1.0f / sqrtf(aa);
+			ax *= n;
+			ay *= n;
+			az *= n;
+
+			float _2q0 = 2.0f * q0, _2q1 = 2.0f * q1, _2q2 = 2.0f * q2, _2q3 = 2.0f * q3;
+			float _4q0 = 4.0f * q0, _4q1 = 4.0f * q1, _4q2 = 4.0f * q2;
+			float _8q1 = 8.0f * q1, _8q2 = 8.0f * q2;
+			float q0q0 = q0 * q0, q1q1 = q1 * q1, q2q2 = q2 * q2, q3q3 = q3 * q3;
+
+			float s0 = _4q0 * q2q2 + _2q2 * ax + _4q0 * q1q1 - _2q1 * ay;
+			float s1 = _4q1 * q3q3 - _2q3 * ax + 4.0f * q0q0 * q1 - _2q0 * ay - _4q1 + _8q1 * q1q1 + _8q1 * q2q2 + _4q1 * az;
+			float s2 = 4.0f * q0q0 * q2 + _2q0 * ax + _4q2 * q3q3 - _2q3 * ay - _4q2 + _8q2 * q1q1 + _8q2 * q2q2 + _4q2 * az;
+			float s3 = 4.0f * q1q1 * q3 - _2q1 * ax + 4.0f * q2q2 * q3 - _2q2 * ay;
+
+			float ss = s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3;
+			if (ss > 0.0f) {
+				n = beta / sqrtf(ss);
+				qDot0 -= n * s0;
+				qDot1 -= n * s1;
+				qDot2 -= n * s2;
+				qDot3 -= n * s3;
+			}
+		}
+
+		q.w = q0 + qDot0 * dt;
+		q.x = q1 + qDot1 * dt;
+		q.y = q2 + qDot2 * dt;
+		q.z = q3 + qDot3 * dt;
+		q.normalize();
+	}
+};
+
+// Mahony's complementary filter: PI feedback of the error between measured
+// and estimated gravity into the gyro rate.
+struct MahonyFilter {
+
+	Quaternion q;
+	float kp = 1.0f;// proportional gain (2 * Kp in Mahony's paper)
+	float ki = 0.0f;// integral gain (2 * Ki), 0 disables bias estimation
+
+	// gyro bias estimate:
+	float integral[3] = { 0, 0, 0 };
+
+	// gyro in rad/s, accel in any unit, dt in seconds:
+	void update(const float gyro[3], const float accel[3], float dt) {
+		float q0 = q.w, q1 = q.x, q2 = q.y, q3 = q.z;
+		float gx = gyro[0], gy = gyro[1], gz = gyro[2];
+		float ax = accel[0], ay = accel[1], az = accel[2];
+
+		float aa = ax * ax + ay * ay + az * az;
+		if (aa > 0.0f) {
+			float n = 1.0f / sqrtf(aa);
+			ax *= n;
+			ay *= n;
+			az *= n;
+
+			// half of the estimated gravity direction:
+			float vx = q1 * q3 - q0 * q2;
+			float vy = q0 * q1 + q2 * q3;
+			float vz = q0 * q0 - 0.5f + q3 * q3;
+
+			// error is the cross product of measured and estimated gravity:
+			float ex = ay * vz - az * vy;
+			float ey = az * vx - ax * vz;
+			float ez = ax * vy - ay * vx;
+
+			if (ki > 0.0f) {
+				integral[0] += ki * ex * dt;
+				integral[1] += ki * ey * dt;
+				integral[2] += ki * ez * dt;
+				gx += integral[0];
+				gy += integral[1];
+				gz += integral[2];
+			}
+
+			gx += kp * ex;
+			gy += kp * ey;
+			gz += kp * ez;
+		}
+
+		gx *= 0.5f * dt;
+		gy *= 0.5f * dt;
+		gz *= 0.5f * dt;
+
+		q.w = q0 + (-q1 * gx - q2 * gy - q3 * gz);
+		q.x = q1 + (q0 * gx + q2 * gz - q3 * gy);
+		q.y = q2 + (q0 * gy - q1 * gz + q3 * gx);
+		q.z = q3 + (q0 * gz + q1 * gy - q2 * gx);
+		q.normalize();
+	}
+};
+
+// Runs a filter over timestamped samples, each step integrates over the
+// real time since the previous sample. Sample needs time (steady_clock),
+// gyro[3] (rad/s) and accel[3], like Joycon::ImuSample.
+template <typename Filter>
+class Fusion {
+
+public:
+
+	Filter filter;
+
+	// samples further apart than this (first sample, lost reports) step by nominalDT:
+	float maxDT = 0.05f;
+	float nominalDT = 0.005f;
+
+	const Quaternion &orientation() const {
+		return filter.q;
+	}
+
+	void reset() {
+		filter = Filter();
+		started = false;
+	}
+
+	// the whole backlog in one call, oldest first:
+	template <typename Sample>
+	void update(const Sample *samples, int count) {
+		for (int i = 0; i < count; ++i) {
+			const Sample &sample = samples[i];
+
+			float dt = nominalDT;
+			if (started) {
+				dt = std::chrono::duration<float>(sample.time - last).count();
+				if (dt <= 0.0f || dt > maxDT) {
+					dt = nominalDT;
+				}
+			}
+			last = sample.time;
+			started = true;
+
+			filter.update(sample.gyro, sample.accel, dt);
+		}
+	}
+
+private:
+
+	bool started = false;
+	std::chrono::steady_clock::time_point last;
+};
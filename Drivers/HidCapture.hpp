@@ -0,0 +1,243 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Joycon.hpp"
+#include "HidReader.hpp"
+
+// Raw HID capture file, written strictly by appending:
+//     "HIDC" | uint32 version | records...
+// Every record is a CaptureRecord followed by length bytes of payload,
+// padded to 8 bytes so the next header is aligned in a mapped file.
+// A device record (CaptureDevice) comes before the first report of its
+// device and carries what decoding needs: type, connection, calibration.
+
+enum CaptureRecordType {
+	CAPTURE_DEVICE = 1,
+	CAPTURE_REPORT = 2,
+};
+
+struct CaptureRecord {
+	uint16_t type;
+	uint16_t device;
+	uint32_t length;// payload bytes
+	int64_t time;// steady_clock nanoseconds, when the report was read
+};
+
+struct CaptureDevice {
+	char name[32];
+	char serial[32];
+	int32_t left_right;
+	int32_t bluetooth;
+	float acc_cal_coeff[3];
+	float gyro_cal_coeff[3];
+	int16_t sensor_cal[2][3];
+	uint16_t stick_cal_x_l[3];
+	uint16_t stick_cal_y_l[3];
+	uint16_t stick_cal_x_r[3];
+	uint16_t stick_cal_y_r[3];
+
+	void from(const Joycon &jc) {
+		memset(this, 0, sizeof(*this));
+		strncpy(this->name, jc.name.c_str(), sizeof(this->name) - 1);
+		for (int i = 0; jc.serial && jc.serial[i] && i < (int)sizeof(this->serial) - 1; ++i) {
+			this->serial[i] = (char)jc.serial[i];
+		}
+		this->left_right = jc.left_right;
+		this->bluetooth = jc.bluetooth;
+		memcpy(this->acc_cal_coeff, jc.acc_cal_coeff, sizeof(this->acc_cal_coeff));
+		memcpy(this->gyro_cal_coeff, jc.gyro_cal_coeff, sizeof(this->gyro_cal_coeff));
+		memcpy(this->sensor_cal, jc.sensor_cal, sizeof(this->sensor_cal));
+		memcpy(this->stick_cal_x_l, jc.stick_cal_x_l, sizeof(this->stick_cal_x_l));
+		memcpy(this->stick_cal_y_l, jc.stick_cal_y_l, sizeof(this->stick_cal_y_l));
+		memcpy(this->stick_cal_x_r, jc.stick_cal_x_r, sizeof(this->stick_cal_x_r));
+		memcpy(this->stick_cal_y_r, jc.stick_cal_y_r, sizeof(this->stick_cal_y_r));
+	}
+
+	void to(Joycon &jc) const {
+		jc.name = std::string(this->name, strnlen(this->name, sizeof(this->name)));
+		jc.left_right = this->left_right;
+		jc.bluetooth = this->bluetooth != 0;
+		memcpy(jc.acc_cal_coeff, this->acc_cal_coeff, sizeof(this->acc_cal_coeff));
+		memcpy(jc.gyro_cal_coeff, this->gyro_cal_coeff, sizeof(this->gyro_cal_coeff));
+		memcpy(jc.sensor_cal, this->sensor_cal, sizeof(this->sensor_cal));
+		memcpy(jc.stick_cal_x_l, this->stick_cal_x_l, sizeof(this->stick_cal_x_l));
+		memcpy(jc.stick_cal_y_l, this->stick_cal_y_l, sizeof(this->stick_cal_y_l));
+		memcpy(jc.stick_cal_x_r, this->stick_cal_x_r, sizeof(this->stick_cal_x_r));
+		memcpy(jc.stick_cal_y_r, this->stick_cal_y_r, sizeof(this->stick_cal_y_r));
+	}
+};
+
+const uint32_t CAPTURE_VERSION = 1;
+
+class HidCaptureWriter {
+
+public:
+
+	~HidCaptureWriter() {
+		close();
+	}
+
+	bool open(const char *path) {
+		close();
+
+		this->fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+		if (this->fd < 0) {
+			perror(path);
+			return false;
+		}
+
+		uint8_t header[8];
+		uint32_t version = CAPTURE_VERSION;
+		memcpy(header, "HIDC", 4);
+		memcpy(header + 4, &version, 4);
+		this->buffer.assign(header, header + sizeof(header));
+		return flush();
+	}
+
+	void close() {
+		if (this->fd >= 0) {
+			::close(this->fd);
+			this->fd = -1;
+		}
+	}
+
+	bool ok() const {
+		return this->fd >= 0;
+	}
+
+	bool device(int index, const Joycon &jc) {
+		CaptureDevice device;
+		device.from(jc);
+		append(CAPTURE_DEVICE, index, std::chrono::steady_clock::now(), &device, sizeof(device));
+		return flush();
+	}
+
+	// a batch of one device's reports, in a single write:
+	bool reports(int index, const HidReport *reports, int count) {
+		for (int i = 0; i < count; ++i) {
+			append(CAPTURE_REPORT, index, reports[i].time, reports[i].data, reports[i].length);
+		}
+		return flush();
+	}
+
+private:
+
+	int fd = -1;
+	std::vector<uint8_t> buffer;
+
+	void append(uint16_t type, int device, std::chrono::steady_clock::time_point time, const void *payload, uint32_t length) {
+		CaptureRecord record;
+		record.type = type;
+		record.device = (uint16_t)device;
+		record.length = length;
+		record.time = std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+
+		const uint8_t *bytes = (const uint8_t*)&record;
+		this->buffer.insert(this->buffer.end(), bytes, bytes + sizeof(record));
+		this->buffer.insert(this->buffer.end(), (const uint8_t*)payload, (const uint8_t*)payload + length);
+		this->buffer.resize((this->buffer.size() + 7) & ~(size_t)7, 0);
+	}
+
+	bool flush() {
+		if (this->fd < 0) return false;
+
+		size_t done = 0;
+		while (done < this->buffer.size()) {
+			ssize_t n = write(this->fd, &this->buffer[done], this->buffer.size() - done);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				perror("capture");
+				close();
+				return false;
+			}
+			done += n;
+		}
+		this->buffer.clear();
+		return true;
+	}
+};
+
+// Reads a capture through a read-only mapping, records are walked in place.
+class HidCaptureReader {
+
+public:
+
+	~HidCaptureReader() {
+		close();
+	}
+
+	bool open(const char *path) {
+		close();
+
+		int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			perror(path);
+			return false;
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) < 0 || st.st_size < 8) {
+			::close(fd);
+			return false;
+		}
+
+		void *map = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		::close(fd);
+		if (map == MAP_FAILED) {
+			perror("mmap");
+			return false;
+		}
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+		this->data = (const uint8_t*)map;
+		this->size = st.st_size;
+
+		uint32_t version;
+		memcpy(&version, this->data + 4, 4);
+		if (memcmp(this->data, "HIDC", 4) != 0 || version != CAPTURE_VERSION) {
+			printf("%s is not a HID capture\n", path);
+			close();
+			return false;
+		}
+
+		rewind();
+		return true;
+	}
+
+	void close() {
+		if (this->data) {
+			munmap((void*)this->data, this->size);
+			this->data = nullptr;
+			this->size = 0;
+		}
+	}
+
+	void rewind() {
+		this->offset = 8;
+	}
+
+	// next complete record, false at the end (or a torn final record):
+	bool next(const CaptureRecord *&record, const uint8_t *&payload) {
+		if (!this->data || this->offset + sizeof(CaptureRecord) > this->size) return false;
+
+		record = (const CaptureRecord*)(this->data + this->offset);
+		size_t end = this->offset + sizeof(CaptureRecord) + record->length;
+		if (end > this->size) return false;
+
+		payload = this->data + this->offset + sizeof(CaptureRecord);
+		this->offset = (end + 7) & ~(size_t)7;
+		return true;
+	}
+
+private:
+
+	const uint8_t *data = nullptr;
+	size_t size = 0;
+	size_t offset = 0;
+};
@@ -0,0 +1,160 @@
+#pragma once
+#include <chrono>
+#include <vector>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "hidapi.c"
+
+// a raw input report, stamped as soon as it was read:
+struct HidReport {
+	int device;// index given to HidReader::add()
+	int length;
+	std::chrono::steady_clock::time_point time;
+	unsigned char data[0x40];
+};
+
+// Waits on the hidraw descriptors of every added device at once, so the
+// thread sleeps until the kernel has a report instead of polling.
+class HidReader {
+
+public:
+
+	HidReader() {
+		this->epoll = epoll_create1(EPOLL_CLOEXEC);
+		if (this->epoll < 0) {
+			perror("epoll_create1");
+			return;
+		}
+
+		// wakes wait() at its deadline, to the microsecond unlike the epoll timeout:
+		this->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+		if (this->timer < 0) {
+			perror("timerfd_create");
+			return;
+		}
+
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u64 = 0;
+		ev.data.fd = this->timer;
+		epoll_ctl(this->epoll, EPOLL_CTL_ADD, this->timer, &ev);
+	}
+
+	~HidReader() {
+		if (this->timer >= 0) {
+			close(this->timer);
+		}
+		if (this->epoll >= 0) {
+			close(this->epoll);
+		}
+	}
+
+	bool add(hid_device *handle, int device) {
+		if (this->epoll < 0 || !handle) return false;
+
+		struct epoll_event ev;
+		ev.events = EPOLLIN;
+		ev.data.u64 = 0;
+		ev.data.fd = hid_get_fd(handle);
+		if (epoll_ctl(this->epoll, EPOLL_CTL_ADD, ev.data.fd, &ev) < 0) {
+			perror("epoll_ctl");
+			return false;
+		}
+
+		if ((int)this->devices.size() <= ev.data.fd) {
+			this->devices.resize(ev.data.fd + 1, -1);
+		}
+		this->devices[ev.data.fd] = device;
+		return true;
+	}
+
+	void remove(hid_device *handle) {
+		if (this->epoll < 0 || !handle) return;
+
+		int fd = hid_get_fd(handle);
+		epoll_ctl(this->epoll, EPOLL_CTL_DEL, fd, nullptr);
+		if (fd < (int)this->devices.size()) {
+			this->devices[fd] = -1;
+		}
+	}
+
+	// Sleeps until at least one device has a report or the deadline passes
+	// (time_point::max() waits forever), then reads one report from every
+	// ready device and passes it to handler(const HidReport &). Devices with
+	// more queued wake the next wait immediately, the descriptors are level
+	// triggered. Returns the number of reports handled, or -1 on error.
+	template <typename Handler>
+	int wait(std::chrono::steady_clock::time_point deadline, Handler handler) {
+		if (this->epoll < 0) return -1;
+
+		int timeoutMS = -1;
+		if (deadline != std::chrono::steady_clock::time_point::max()) {
+			if (this->timer >= 0) {
+				// steady_clock is CLOCK_MONOTONIC on Linux:
+				std::chrono::nanoseconds since = std::chrono::duration_cast<std::chrono::nanoseconds>(deadline.time_since_epoch());
+				struct itimerspec its = {};
+				its.it_value.tv_sec = (time_t)(since.count() / 1000000000);
+				its.it_value.tv_nsec = (long)(since.count() % 1000000000);
+				if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {
+					its.it_value.tv_nsec = 1;// zero would disarm it
+				}
+				timerfd_settime(this->timer, TFD_TIMER_ABSTIME, &its, nullptr);
+			} else {
+				// round up so we don't wake just before the deadline and spin:
+				long long us = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+				timeoutMS = us > 0 ? (int)((us + 999) / 1000) : 0;
+			}
+		}
+
+		struct epoll_event events[64];
+		int ready = epoll_wait(this->epoll, events, 64, timeoutMS);
+		if (ready < 0) {
+			return errno == EINTR ? 0 : -1;
+		}
+
+		int handled = 0;
+		for (int i = 0; i < ready; ++i) {
+			int fd = events[i].data.fd;
+
+			// deadline reached, clear the expiration:
+			if (fd == this->timer) {
+				uint64_t expirations;
+				if (read(fd, &expirations, sizeof(expirations)) < 0) {}
+				continue;
+			}
+
+			// unplugged or powered off:
+			if (!(events[i].events & EPOLLIN)) {
+				epoll_ctl(this->epoll, EPOLL_CTL_DEL, fd, nullptr);
+				continue;
+			}
+
+			// the descriptor is blocking, but EPOLLIN means this read won't block:
+			HidReport report;
+			report.length = read(fd, report.data, sizeof(report.data));
+			report.time = std::chrono::steady_clock::now();
+			if (report.length <= 0) {
+				continue;
+			}
+			// decoders may look past short reports:
+			memset(report.data + report.length, 0, sizeof(report.data) - report.length);
+			report.device = this->devices[fd];
+
+			handler(report);
+			handled++;
+		}
+
+		return handled;
+	}
+
+private:
+
+	int epoll = -1;
+	int timer = -1;
+
+	// device index by file descriptor:
+	std::vector<int> devices;
+};
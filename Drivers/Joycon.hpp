@@ -1,7 +1,13 @@
+#pragma once
 #include <bitset>
+#include <chrono>
 #include "hidapi.c"
 #include <wchar.h>
 #include "tools.hpp"
+#include "ReportDecoder.hpp"
+#include "SubcommandEngine.hpp"
+#include "CalibrationCache.hpp"
+#include "Fusion.hpp"
 
 #define JOYCON_VENDOR 0x057e
 #define JOYCON_L_BT 0x2006
@@ -26,8 +32,7 @@ public:
 
 	int left_right = 0;// 1: left joycon, 2: right joycon, 3: pro controller
 
-	uint16_t buttons = 0;
-	uint16_t buttons2 = 0;// for pro controller
+	JoyconState state = {};// last decoded report
 
 	
 	struct btn_states {
@@ -101,6 +106,26 @@ public:
 		float z = 0;
 	} accel;
 
+	// 0x30 / 0x31 reports carry three IMU samples taken 5ms apart, oldest first:
+	struct ImuSample {
+		std::chrono::steady_clock::time_point time;
+		float accel[3];// m/s^2
+		float gyro[3];// rad/s, offset removed (roll, pitch, yaw)
+	};
+
+	ImuSample imu[3];
+	int imu_count = 0;// samples decoded from the last report
+
+	// device clock rebuilt from the report timer byte:
+	struct ImuClock {
+		bool started = false;
+		uint8_t timer = 0;
+		std::chrono::steady_clock::time_point time;
+	} imu_clock;
+
+	// orientation fused from every IMU sample:
+	Fusion<MadgwickFilter> orientation;
+
 
 	// calibration data:
 
@@ -223,6 +248,9 @@ public:
 		}
 	}
 
+	// controller without a device, e.g. one replayed from a capture:
+	Joycon() : handle(nullptr), serial(nullptr) {}
+
 	void hid_exchange(hid_device *handle, unsigned char *buf, int len) {
 		if (!handle) return;
 
@@ -249,8 +277,8 @@ public:
 	}
 
 
-	void send_command(int command, uint8_t *data, int len) {
-		unsigned char buf[0x40];
+	// builds the output report for command into buf, returns its length:
+	int build_command(unsigned char *buf, int command, const uint8_t *data, int len) {
 		memset(buf, 0, 0x40);
 
 		if (!bluetooth) {
@@ -264,7 +292,21 @@ public:
 			memcpy(buf + (bluetooth ? 0x1 : 0x9), data, len);
 		}
 
-		hid_exchange(this->handle, buf, len + (bluetooth ? 0x1 : 0x9));
+		return len + (bluetooth ? 0x1 : 0x9);
+	}
+
+	// sends command without waiting, the reply arrives with the input reports:
+	void post_command(int command, const uint8_t *data, int len) {
+		if (!this->handle) return;
+
+		unsigned char buf[0x40];
+		hid_write(this->handle, buf, build_command(buf, command, data, len));
+	}
+
+	void send_command(int command, uint8_t *data, int len) {
+		unsigned char buf[0x40];
+
+		hid_exchange(this->handle, buf, build_command(buf, command, data, len));
 
 		if (data) {
 			memcpy(data, buf, 0x40);
@@ -327,10 +369,8 @@ public:
 			buf[1 + 4] = frequency;// (0, 255)
 		}
 
-		// set non-blocking:
-		hid_set_nonblocking(this->handle, 1);
-
-		send_command(0x10, (uint8_t*)buf, 0x9);
+		// rumble has no reply, don't read (and drop) an input report for it:
+		post_command(0x10, (uint8_t*)buf, 0x9);
 	}
 
 	void rumble2(uint16_t hf, uint8_t hfa, uint8_t lf, uint16_t lfa) {
@@ -360,10 +400,8 @@ public:
 		buf[3 + off] = lfa & 0xFF;
 
 
-		// set non-blocking:
-		hid_set_nonblocking(this->handle, 1);
-
-		send_command(0x10, (uint8_t*)buf, 0x9);
+		// rumble has no reply, don't read (and drop) an input report for it:
+		post_command(0x10, (uint8_t*)buf, 0x9);
 	}
 
 	void rumble3(float frequency, uint8_t hfa, uint16_t lfa) {
@@ -442,13 +480,31 @@ public:
 		buf[3 + off] = lfa & 0xFF;
 
 
-		// set non-blocking:
-		hid_set_nonblocking(this->handle, 1);
-
-		send_command(0x10, (uint8_t*)buf, 0x9);
+		// rumble has no reply, don't read (and drop) an input report for it:
+		post_command(0x10, (uint8_t*)buf, 0x9);
 	}
 
 
+	// Time the newest IMU sample of a report was taken. The timer byte counts
+	// one tick per IMU sample period, so successive reports are spaced by the
+	// device's clock instead of Bluetooth arrival jitter. The clock is pulled
+	// back to the arrival time whenever it runs ahead of it (a sample can't
+	// arrive before it was taken) or falls far behind (lost reports, drift).
+	std::chrono::steady_clock::time_point imu_report_time(uint8_t timer, std::chrono::steady_clock::time_point arrival) {
+		const std::chrono::microseconds tick(5000);
+
+		if (this->imu_clock.started) {
+			this->imu_clock.time += tick * (uint8_t)(timer - this->imu_clock.timer);
+		}
+		if (!this->imu_clock.started || this->imu_clock.time > arrival || arrival - this->imu_clock.time > std::chrono::milliseconds(50)) {
+			this->imu_clock.time = arrival;
+			this->imu_clock.started = true;
+		}
+		this->imu_clock.timer = timer;
+
+		return this->imu_clock.time;
+	}
+
 	void setGyroOffsets() {
 		float thresh = 0.1;
 		if (std::abs(this->gyro.roll) > thresh || std::abs(this->gyro.pitch) > thresh || std::abs(this->gyro.yaw) > thresh) {
@@ -466,26 +522,23 @@ public:
 	}
 
 
-	int init_bt() {
+	// Input reports that arrive while initializing go to sink, replies included.
+	// With a cache, a controller seen before only reads its user calibration.
+	int init_bt(SubcommandEngine::InputSink sink = SubcommandEngine::InputSink(), CalibrationCache *cache = nullptr) {
 
 		this->bluetooth = true;
 
-		unsigned char buf[0x40];
-		memset(buf, 0, 0x40);
-
-
-		// set blocking to ensure command is recieved:
-		hid_set_nonblocking(this->handle, 0);
+		// every request below is pipelined and matched to its reply:
+		SubcommandEngine engine(this->handle, this->global_count, sink);
+		uint8_t enable = 0x01;
 
 		// Enable vibration
 		printf("Enabling vibration...\n");
-		buf[0] = 0x01; // Enabled
-		send_subcommand(0x1, 0x48, buf, 1);
+		engine.submit(0x48, &enable, 1, 0, nullptr);
 
 		// Enable IMU data
 		printf("Enabling IMU data...\n");
-		buf[0] = 0x01; // Enabled
-		send_subcommand(0x01, 0x40, buf, 1);
+		engine.submit(0x40, &enable, 1, 0, nullptr);
 
 
 		// Set input report mode (to push at 60hz)
@@ -497,8 +550,8 @@ public:
 		// 30	NPad standard mode. Pushes current state @60Hz. Default in SDK if arg is not in the list
 		// 31	NFC mode. Pushes large packets @60Hz
 		printf("Set input report mode to 0x30...\n");
-		buf[0] = 0x30;
-		send_subcommand(0x01, 0x03, buf, 1);
+		uint8_t mode = 0x30;
+		engine.submit(0x03, &mode, 1, 0, nullptr);
 
 		// @CTCaer
 
@@ -519,13 +572,69 @@ public:
 		memset(stick_cal_y_r, 0, sizeof(stick_cal_y_r));
 
 
-		get_spi_data(0x6020, 0x18, factory_sensor_cal);
-		get_spi_data(0x603D, 0x12, factory_stick_cal);
-		get_spi_data(0x6080, 0x6, sensor_model);
-		get_spi_data(0x6086, 0x12, stick_model);
-		get_spi_data(0x6098, 0x12, &stick_model[0x12]);
-		get_spi_data(0x8010, 0x16, user_stick_cal);
-		get_spi_data(0x8026, 0x1A, user_sensor_cal);
+		struct {
+			uint32_t offset;
+			uint8_t size;
+			uint8_t *data;
+		} spi[] = {
+			{ 0x6020, 0x18, factory_sensor_cal },
+			{ 0x603D, 0x12, factory_stick_cal },
+			{ 0x6080, 0x6, sensor_model },
+			{ 0x6086, 0x12, stick_model },
+			{ 0x6098, 0x12, &stick_model[0x12] },
+			{ 0x8010, 0x16, user_stick_cal },
+			{ 0x8026, 0x1A, user_sensor_cal },
+		};
+		const int spiCount = sizeof(spi) / sizeof(spi[0]);
+		uint8_t replies[spiCount][0x40] = {};
+
+		// factory data doesn't change, a controller seen before only reads the user blocks (the last two):
+		CalibrationRecord record;
+		bool cached = cache && cache->find(this->serial, record);
+		int firstRead = cached ? spiCount - 2 : 0;
+
+		for (int i = firstRead; i < spiCount; ++i) {
+			engine.submitSpiRead(spi[i].offset, spi[i].size, replies[i]);
+		}
+
+		int failed = engine.run();
+		if (failed > 0) {
+			printf("Some commands to %s got no reply.\n", this->name.c_str());
+		}
+
+		// the data of each read starts at 0x14 of its reply:
+		for (int i = firstRead; i < spiCount; ++i) {
+			memcpy(spi[i].data, replies[i] + 0x14, spi[i].size);
+		}
+
+		if (cached) {
+			printf("Using cached factory calibration for %ls\n", this->serial);
+			memcpy(factory_sensor_cal, record.factory_sensor_cal, sizeof(record.factory_sensor_cal));
+			memcpy(factory_stick_cal, record.factory_stick_cal, sizeof(record.factory_stick_cal));
+			memcpy(sensor_model, record.sensor_model, sizeof(record.sensor_model));
+			memcpy(stick_model, record.stick_model, sizeof(record.stick_model));
+
+			// a user block that got no reply (still zeroed) keeps the last one read:
+			if (failed > 0 && replies[spiCount - 2][0] != 0x21) {
+				memcpy(user_stick_cal, record.user_stick_cal, sizeof(record.user_stick_cal));
+			}
+			if (failed > 0 && replies[spiCount - 1][0] != 0x21) {
+				memcpy(user_sensor_cal, record.user_sensor_cal, sizeof(record.user_sensor_cal));
+			}
+		}
+
+		// remember new controllers and changed user calibration, unless something failed to read:
+		if (cache && failed == 0 && (!cached ||
+			memcmp(record.user_stick_cal, user_stick_cal, sizeof(record.user_stick_cal)) != 0 ||
+			memcmp(record.user_sensor_cal, user_sensor_cal, sizeof(record.user_sensor_cal)) != 0)) {
+			memcpy(record.factory_sensor_cal, factory_sensor_cal, sizeof(record.factory_sensor_cal));
+			memcpy(record.factory_stick_cal, factory_stick_cal, sizeof(record.factory_stick_cal));
+			memcpy(record.sensor_model, sensor_model, sizeof(record.sensor_model));
+			memcpy(record.stick_model, stick_model, sizeof(record.stick_model));
+			memcpy(record.user_stick_cal, user_stick_cal, sizeof(record.user_stick_cal));
+			memcpy(record.user_sensor_cal, user_sensor_cal, sizeof(record.user_sensor_cal));
+			cache->store(this->serial, record);
+		}
 
 
 		// get stick calibration data:
@@ -0,0 +1,168 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <sys/prctl.h>
+
+#include "Joycon.hpp"
+#include "HidReader.hpp"
+#include "SpscRing.hpp"
+#include "tools.hpp"
+
+// raw reports of one joycon, filled by the reader thread:
+typedef SpscRing<HidReport, 256> ReportQueue;
+
+// A connected controller and everything that belongs only to it, nothing
+// here is shared with other devices.
+struct JoyconDevice {
+
+	Joycon joycon;
+	ReportQueue reports;
+	PeriodicDeadline poll;
+
+	JoyconDevice(struct hid_device_info *dev, std::chrono::steady_clock::duration pollPeriod) :
+		joycon(dev), poll(pollPeriod) {}
+};
+
+// Finds, initializes and reads any number of controllers. One reader thread
+// waits on all of them with a single epoll set, so a report from any device
+// is handled as soon as it arrives no matter how many others are connected.
+// Each device keeps its own poll deadline; they are spread evenly over the
+// period so the writes don't bunch up behind each other.
+class JoyconManager {
+
+public:
+
+	std::chrono::steady_clock::duration pollPeriod = std::chrono::microseconds(1000000 / 60);
+
+	~JoyconManager() {
+		stop();
+	}
+
+	// opens every supported controller, returns how many were found:
+	int open() {
+		struct hid_device_info *devs = hid_enumerate(JOYCON_VENDOR, 0x0);
+		for (struct hid_device_info *cur_dev = devs; cur_dev; cur_dev = cur_dev->next) {
+
+			// identify by vendor:
+			if (cur_dev->vendor_id != JOYCON_VENDOR) continue;
+
+			// bluetooth, left / right joycon and pro controller:
+			if (cur_dev->product_id == JOYCON_L_BT || cur_dev->product_id == JOYCON_R_BT || cur_dev->product_id == PRO_CONTROLLER) {
+				this->devices.emplace_back(new JoyconDevice(cur_dev, this->pollPeriod));
+			}
+		}
+		hid_free_enumeration(devs);
+
+		return (int)this->devices.size();
+	}
+
+	// Runs init_bt() / init_usb() on every device at once, each exchange
+	// only waits on its own controller.
+	void initialize(bool usb) {
+		this->calibration.load();
+
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < this->devices.size(); ++i) {
+			JoyconDevice *device = this->devices[i].get();
+			CalibrationCache *cache = &this->calibration;
+			threads.push_back(std::thread([device, usb, cache]() {
+				if (usb) {
+					device->joycon.init_usb();
+				} else {
+					// keep the input reports that arrive in between:
+					device->joycon.init_bt([device](const HidReport &report) {
+						device->reports.push(report);
+					}, cache);
+				}
+			}));
+		}
+		for (size_t i = 0; i < threads.size(); ++i) {
+			threads[i].join();
+		}
+
+		if (!this->calibration.save()) {
+			printf("Could not save the calibration cache.\n");
+		}
+
+		// stagger the polls:
+		std::chrono::steady_clock::time_point tNow = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < this->devices.size(); ++i) {
+			this->devices[i]->poll.next = tNow + this->pollPeriod * i / this->devices.size();
+			this->reader.add(this->devices[i]->joycon.handle, (int)i);
+		}
+	}
+
+	// Services polls and reads reports once on the calling thread, for use
+	// before start() while commands still read their replies inline.
+	void pollOnce() {
+		pollLoop();
+	}
+
+	// hands reading over to the reader thread:
+	void start() {
+		if (this->running) return;
+
+		this->running = true;
+		this->thread = std::thread([this]() {
+			// let the kernel wake us right at poll deadlines instead of up to 50us late:
+			prctl(PR_SET_TIMERSLACK, 1000);
+
+			while (this->running.load(std::memory_order_relaxed)) {
+				pollLoop();
+			}
+		});
+	}
+
+	void stop() {
+		if (!this->running) return;
+
+		this->running = false;
+		this->thread.join();
+	}
+
+	int size() const {
+		return (int)this->devices.size();
+	}
+
+	JoyconDevice &operator[](int i) {
+		return *this->devices[i];
+	}
+
+private:
+
+	// unique_ptr keeps every device at a fixed address for the reader thread:
+	std::vector<std::unique_ptr<JoyconDevice>> devices;
+
+	HidReader reader;
+	CalibrationCache calibration;
+	std::thread thread;
+	std::atomic<bool> running{ false };
+
+	void pollLoop() {
+
+		std::chrono::steady_clock::time_point tNow = std::chrono::steady_clock::now();
+		std::chrono::steady_clock::time_point tNextPoll = std::chrono::steady_clock::time_point::max();
+
+		// request a state update from every joycon that's due one:
+		for (size_t i = 0; i < this->devices.size(); ++i) {
+			JoyconDevice &device = *this->devices[i];
+
+			if (!device.joycon.handle) { continue; }
+
+			if (device.poll.due(tNow)) {
+				device.joycon.post_command(0x1E, nullptr, 0);
+				device.poll.advance(tNow);
+			}
+
+			tNextPoll = std::min(tNextPoll, device.poll.next);
+		}
+
+		// sleep until a report arrives or the next poll is due,
+		// queue input for the consumer:
+		this->reader.wait(tNextPoll, [this](const HidReport &report) {
+			this->devices[report.device]->reports.push(report);
+		});
+	}
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+// Button bits of JoyconState::buttons. They are the three button bytes of a
+// standard report (right, shared, left) read as one little endian word, so
+// every controller type uses the same bits and decoding is a single mask.
+enum JoyconButton {
+	// right:
+	JC_Y = 1 << 0,
+	JC_X = 1 << 1,
+	JC_B = 1 << 2,
+	JC_A = 1 << 3,
+	JC_SR_R = 1 << 4,
+	JC_SL_R = 1 << 5,
+	JC_R = 1 << 6,
+	JC_ZR = 1 << 7,
+
+	// shared:
+	JC_MINUS = 1 << 8,
+	JC_PLUS = 1 << 9,
+	JC_STICK_R = 1 << 10,
+	JC_STICK_L = 1 << 11,
+	JC_HOME = 1 << 12,
+	JC_CAPTURE = 1 << 13,
+
+	// left:
+	JC_DOWN = 1 << 16,
+	JC_UP = 1 << 17,
+	JC_RIGHT = 1 << 18,
+	JC_LEFT = 1 << 19,
+	JC_SR_L = 1 << 20,
+	JC_SL_L = 1 << 21,
+	JC_L = 1 << 22,
+	JC_ZL = 1 << 23,
+};
+
+// Where a controller type keeps its data in a 0x21 / 0x30 / 0x31 report.
+struct JoyconLayout {
+	uint32_t buttons;// bits this controller actually has
+	uint8_t stick[2];// byte offset of the main and second stick
+	uint8_t stickButton[2];// bit index of the stick buttons, 14 is never set
+};
+
+// indexed by Joycon::left_right, 0 is an unidentified device:
+constexpr JoyconLayout JOYCON_LAYOUTS[4] = {
+	{ 0, { 6, 9 }, { 14, 14 } },
+	{ 0xFF0000 | JC_MINUS | JC_STICK_L | JC_CAPTURE, { 6, 6 }, { 11, 14 } },
+	{ 0x0000FF | JC_PLUS | JC_STICK_R | JC_HOME, { 9, 9 }, { 10, 14 } },
+	{ 0xCF3FCF, { 6, 9 }, { 11, 10 } },
+};
+
+// One decoded report, raw values without calibration.
+struct JoyconState {
+	uint32_t buttons;// JoyconButton bits
+	uint16_t stick[2][2];// 12 bit x, y of the main and second (Pro Controller right) stick
+	int16_t imu[3][6];// accel x, y, z and gyro x, y, z per sample, oldest first
+	uint8_t id;// report id
+	uint8_t timer;
+	uint8_t battery;// level in the high bits, charging in bit 0
+	uint8_t imuCount;// 3 for 0x30 / 0x31, 0 when imu is not sensor data
+};
+
+// Decodes a standard input report starting at its id byte. The same fixed
+// sequence of loads and shifts runs for every controller type, the layout
+// only supplies offsets and masks. report must hold at least 49 bytes.
+inline void DecodeReport(const JoyconLayout &layout, const uint8_t *report, JoyconState &state) {
+	state.id = report[0];
+	state.timer = report[1];
+	state.battery = report[2] >> 4;
+	state.buttons = (report[3] | (report[4] << 8) | (report[5] << 16)) & layout.buttons;
+
+	for (int s = 0; s < 2; ++s) {
+		const uint8_t *stick = report + layout.stick[s];
+		state.stick[s][0] = stick[0] | ((stick[1] & 0xF) << 8);
+		state.stick[s][1] = (stick[1] >> 4) | (stick[2] << 4);
+	}
+
+	// three samples of six little endian int16:
+	memcpy(state.imu, report + 13, sizeof(state.imu));
+	state.imuCount = 3 * ((state.id | 1) == 0x31);
+}
+
+// Decodes count reports stride bytes apart, e.g. a ring buffer backlog or a capture file.
+inline void DecodeReports(const JoyconLayout &layout, const uint8_t *reports, size_t stride, int count, JoyconState *states) {
+	for (int i = 0; i < count; ++i) {
+		DecodeReport(layout, reports + i * stride, states[i]);
+	}
+}
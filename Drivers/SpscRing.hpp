@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+
+// Fixed size single producer / single consumer queue. One thread may push
+// and one other thread may pop concurrently without locks; head is only
+// written by the producer and tail only by the consumer.
+// Capacity must be a power of two so indices wrap with a mask.
+template <typename T, unsigned Capacity>
+class SpscRing {
+
+	static_assert(Capacity && (Capacity & (Capacity - 1)) == 0, "SpscRing capacity must be a power of two");
+
+public:
+
+	// producer: false (and the item is dropped) when the consumer is a full ring behind
+	bool push(const T &item) {
+		unsigned head = this->head.load(std::memory_order_relaxed);
+		if (head - this->tailCache == Capacity) {
+			this->tailCache = this->tail.load(std::memory_order_acquire);
+			if (head - this->tailCache == Capacity) {
+				this->dropped.store(this->dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+				return false;
+			}
+		}
+
+		this->items[head & (Capacity - 1)] = item;
+		this->head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// consumer: oldest item, false when empty
+	bool pop(T &item) {
+		return pop(&item, 1) == 1;
+	}
+
+	// consumer: moves up to max of the oldest items into out in order,
+	// returns how many
+	int pop(T *out, int max) {
+		unsigned tail = this->tail.load(std::memory_order_relaxed);
+		if (this->headCache - tail < (unsigned)max) {
+			this->headCache = this->head.load(std::memory_order_acquire);
+		}
+
+		unsigned count = this->headCache - tail;
+		if (count > (unsigned)max) {
+			count = max;
+		}
+
+		for (unsigned i = 0; i < count; ++i) {
+			out[i] = this->items[(tail + i) & (Capacity - 1)];
+		}
+		this->tail.store(tail + count, std::memory_order_release);
+		return count;
+	}
+
+	// approximate from any thread, exact from the consumer
+	unsigned size() const {
+		return this->head.load(std::memory_order_acquire) - this->tail.load(std::memory_order_acquire);
+	}
+
+	// items the producer had to throw away because the ring was full
+	unsigned overflows() const {
+		return this->dropped.load(std::memory_order_relaxed);
+	}
+
+private:
+
+	// Each side's indices are padded out to a cache line of their own so the
+	// two threads don't false-share. Explicit padding rather than alignas(64):
+	// C++11 new doesn't honour extended alignment, and rings live in heap
+	// allocated JoyconDevices.
+
+	// producer side:
+	std::atomic<unsigned> head{ 0 };
+	unsigned tailCache = 0;
+	std::atomic<unsigned> dropped{ 0 };
+	char producerPad[64 - 2 * sizeof(std::atomic<unsigned>) - sizeof(unsigned)];
+
+	// consumer side:
+	std::atomic<unsigned> tail{ 0 };
+	unsigned headCache = 0;
+	char consumerPad[64 - sizeof(std::atomic<unsigned>) - sizeof(unsigned)];
+
+	T items[Capacity];
+};
@@ -0,0 +1,179 @@
+#pragma once
+#include <chrono>
+#include <functional>
+#include <vector>
+#include <string.h>
+#include "HidReader.hpp"
+
+// Sends Bluetooth subcommands (output report 0x01) without waiting for each
+// reply in turn. Up to window requests are in flight at once, every 0x21
+// reply is matched to its request by the echoed subcommand id (plus the
+// echoed arguments, e.g. the SPI address of a flash read), and requests that
+// time out or are NACKed are sent again. Every report read meanwhile,
+// replies included, still goes to the input sink so no input is lost.
+class SubcommandEngine {
+
+public:
+
+	typedef std::function<void(const HidReport &)> InputSink;
+
+	int window = 4;
+	int timeoutMS = 100;
+	int retries = 5;// sends per request before it fails
+
+	// packetNumber is the device's rolling global_count, shared with send_subcommand():
+	SubcommandEngine(hid_device *handle, int &packetNumber, InputSink sink = InputSink()) :
+		handle(handle), packetNumber(packetNumber), sink(sink) {}
+
+	// Queues a subcommand. The reply matches when it echoes the subcommand id
+	// and the first echo bytes of args. The whole 0x21 reply report is copied
+	// to reply (0x40 bytes) if it isn't null.
+	void submit(uint8_t subcommand, const uint8_t *args, int len, int echo, uint8_t *reply) {
+		Request request;
+		request.subcommand = subcommand;
+		request.len = std::min(len, (int)sizeof(request.args));
+		memcpy(request.args, args, request.len);
+		request.echo = std::min(echo, request.len);
+		request.reply = reply;
+		this->requests.push_back(request);
+	}
+
+	// SPI flash read of size bytes at offset, data ends up at reply + 0x14:
+	void submitSpiRead(uint32_t offset, uint8_t size, uint8_t *reply) {
+		uint8_t args[5] = { (uint8_t)offset, (uint8_t)(offset >> 8), (uint8_t)(offset >> 16), (uint8_t)(offset >> 24), size };
+		submit(0x10, args, 5, 5, reply);
+	}
+
+	// Sends everything queued and reads until each request is answered or out
+	// of retries. Returns the number of requests that failed.
+	int run() {
+		using namespace std::chrono;
+
+		int remaining = (int)this->requests.size();
+		int failed = 0;
+		int inFlight = 0;
+
+		while (remaining > 0) {
+
+			// retire timeouts, then fill the window in submission order:
+			steady_clock::time_point tNow = steady_clock::now();
+			steady_clock::time_point tNext = steady_clock::time_point::max();
+			for (size_t i = 0; i < this->requests.size(); ++i) {
+				Request &request = this->requests[i];
+				if (request.done) continue;
+
+				if (request.inFlight && tNow >= request.deadline) {
+					request.inFlight = false;
+					inFlight--;
+				}
+				if (!request.inFlight && request.tries >= this->retries) {
+					request.done = true;
+					remaining--;
+					failed++;
+					continue;
+				}
+				if (!request.inFlight && inFlight < this->window) {
+					if (!send(request)) {
+						return failed + remaining;
+					}
+					request.tries++;
+					request.inFlight = true;
+					request.deadline = tNow + milliseconds(this->timeoutMS);
+					inFlight++;
+				}
+				if (request.inFlight) {
+					tNext = std::min(tNext, request.deadline);
+				}
+			}
+			if (remaining == 0) break;
+
+			// wait for the next report, at most until the first deadline:
+			int waitMS = 0;
+			if (tNext != steady_clock::time_point::max()) {
+				long long us = duration_cast<microseconds>(tNext - steady_clock::now()).count();
+				waitMS = us > 0 ? (int)((us + 999) / 1000) : 0;
+			}
+
+			HidReport report;
+			report.device = -1;
+			report.length = hid_read_timeout(this->handle, report.data, sizeof(report.data), waitMS);
+			report.time = steady_clock::now();
+			if (report.length < 0) {
+				// unplugged:
+				return failed + remaining;
+			}
+			if (report.length == 0) continue;
+			memset(report.data + report.length, 0, sizeof(report.data) - report.length);
+
+			// 0x21: byte 13 is the ACK (high bit set), 14 the subcommand id, 15- the reply data:
+			if (report.data[0] == 0x21) {
+				Request *request = match(report.data);
+				if (request) {
+					request->inFlight = false;
+					inFlight--;
+					if (report.data[13] & 0x80) {
+						if (request->reply) {
+							memcpy(request->reply, report.data, 0x40);
+						}
+						request->done = true;
+						remaining--;
+					}
+				}
+			}
+
+			if (this->sink) {
+				this->sink(report);
+			}
+		}
+
+		this->requests.clear();
+		return failed;
+	}
+
+private:
+
+	struct Request {
+		uint8_t subcommand = 0;
+		uint8_t args[0x30];
+		int len = 0;
+		int echo = 0;
+		uint8_t *reply = nullptr;
+		int tries = 0;
+		bool inFlight = false;
+		bool done = false;
+		std::chrono::steady_clock::time_point deadline;
+	};
+
+	hid_device *handle;
+	int &packetNumber;
+	InputSink sink;
+	std::vector<Request> requests;
+
+	// oldest in-flight request this reply answers:
+	Request *match(const uint8_t *reply) {
+		for (size_t i = 0; i < this->requests.size(); ++i) {
+			Request &request = this->requests[i];
+			if (request.inFlight && reply[14] == request.subcommand && memcmp(reply + 15, request.args, request.echo) == 0) {
+				return &request;
+			}
+		}
+		return nullptr;
+	}
+
+	bool send(const Request &request) {
+		uint8_t buf[0x40];
+		memset(buf, 0, sizeof(buf));
+
+		// same layout as Joycon::send_subcommand() over Bluetooth:
+		uint8_t rumble_base[9] = { (uint8_t)((++this->packetNumber) & 0xF), 0x00, 0x01, 0x40, 0x40, 0x00, 0x01, 0x40, 0x40 };
+		if (this->packetNumber > 0xF) {
+			this->packetNumber = 0x0;
+		}
+		buf[0] = 0x01;
+		memcpy(buf + 1, rumble_base, 9);
+		buf[10] = request.subcommand;
+		memcpy(buf + 11, request.args, request.len);
+
+		return hid_write(this->handle, buf, 11 + request.len) >= 0;
+	}
+};
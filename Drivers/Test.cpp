@@ -9,8 +9,10 @@
 
 //#include "hidapi.c"
 
-#include "packet.h"
+#include "ReportDecoder.hpp"
 #include "Joycon.hpp"
+#include "JoyconManager.hpp"
+#include "HidCapture.hpp"
 #include "tools.hpp"
 
 
@@ -23,8 +25,9 @@
 #define PI 3.14159265359
 #define L_OR_R(lr) (lr == 1 ? 'L' : (lr == 2 ? 'R' : '?'))
 
-std::vector<Joycon> joycons;
-unsigned char buf[65];
+JoyconManager joycons;
+HidCaptureWriter capture;
+
 int res = 0;
 
 using namespace std;
@@ -46,23 +49,16 @@ struct Tracker {
 	float angley = 0;
 	float anglez = 0;
 
-	//glm::fquat quat = glm::angleAxis(0.0f, glm::vec3(1.0, 0.0, 0.0));
-
-	vector<chrono::high_resolution_clock::time_point> tPolls;
-
 	float previousPitch = 0;
 
 } tracker;
 
 
-void handle_input(Joycon *jc, uint8_t *packet, int len) {
+void handle_input(Joycon *jc, uint8_t *packet, int len, chrono::steady_clock::time_point time) {
 
 	// bluetooth button pressed packet:
 	if (packet[0] == 0x3F) {
 
-		uint16_t old_buttons = jc->buttons;
-		int8_t old_dstick = jc->dstick;
-
 		jc->dstick = packet[3];
 		// todo: get button states here aswell:
 	}
@@ -75,370 +71,140 @@ void handle_input(Joycon *jc, uint8_t *packet, int len) {
 		/*int offset = settings.usingBluetooth ? 0 : 10;*/
 		int offset = jc->bluetooth ? 0 : 10;
 
-		uint8_t *btn_data = packet + offset + 3;
-
-		// get button states:
-		{
-			uint16_t states = 0;
-			uint16_t states2 = 0;
-
-			// Left JoyCon:
-			if (jc->left_right == 1) {
-				states = (btn_data[1] << 8) | (btn_data[2] & 0xFF);
-				// Right JoyCon:
-			} else if (jc->left_right == 2) {
-				states = (btn_data[1] << 8) | (btn_data[0] & 0xFF);
-				// Pro Controller:
-			} else if (jc->left_right == 3) {
-				states = (btn_data[1] << 8) | (btn_data[2] & 0xFF);
-				states2 = (btn_data[1] << 8) | (btn_data[0] & 0xFF);
-			}
-
-			jc->buttons = states;
-			// Pro Controller:
-			if (jc->left_right == 3) {
-				jc->buttons2 = states2;
-
-				// fix some non-sense the Pro Controller does
-				// clear nth bit
-				//num &= ~(1UL << n);
-				jc->buttons &= ~(1UL << 9);
-				jc->buttons &= ~(1UL << 10);
-				jc->buttons &= ~(1UL << 12);
-				jc->buttons &= ~(1UL << 14);
-
-				jc->buttons2 &= ~(1UL << 8);
-				jc->buttons2 &= ~(1UL << 11);
-				jc->buttons2 &= ~(1UL << 13);
-			}
-		}
-
-		// get stick data:
-		uint8_t *stick_data = packet + offset;
-		if (jc->left_right == 1) {
-			stick_data += 6;
-		} else if (jc->left_right == 2) {
-			stick_data += 9;
-		}
+		JoyconState &state = jc->state;
+		const JoyconLayout &layout = JOYCON_LAYOUTS[jc->left_right & 3];
+		DecodeReport(layout, packet + offset, state);
 
-		uint16_t stick_x = stick_data[0] | ((stick_data[1] & 0xF) << 8);
-		uint16_t stick_y = (stick_data[1] >> 4) | (stick_data[2] << 4);
-		jc->stick.x = stick_x;
-		jc->stick.y = stick_y;
-
-		// use calibration data:
+		// get stick data, use calibration data:
+		jc->stick.x = state.stick[0][0];
+		jc->stick.y = state.stick[0][1];
+		jc->stick2.x = state.stick[1][0];
+		jc->stick2.y = state.stick[1][1];
 		jc->CalcAnalogStick();
 
-		// pro controller:
-		if (jc->left_right == 3) {
-			stick_data += 6;
-			uint16_t stick_x = stick_data[0] | ((stick_data[1] & 0xF) << 8);
-			uint16_t stick_y = (stick_data[1] >> 4) | (stick_data[2] << 4);
-			jc->stick.x = (int)(unsigned int)stick_x;
-			jc->stick.y = (int)(unsigned int)stick_y;
-			stick_data += 3;
-			uint16_t stick_x2 = stick_data[0] | ((stick_data[1] & 0xF) << 8);
-			uint16_t stick_y2 = (stick_data[1] >> 4) | (stick_data[2] << 4);
-			jc->stick2.x = (int)(unsigned int)stick_x2;
-			jc->stick2.y = (int)(unsigned int)stick_y2;
-
-			// calibration data:
-			jc->CalcAnalogStick();
-		}
-
-		jc->battery = (stick_data[1] & 0xF0) >> 4;
+		jc->battery = state.battery;
 		//printf("JoyCon battery: %d\n", jc->battery);
 
-		// Accelerometer:
-		// Accelerometer data is absolute (m/s^2)
-		{
-
-			// get accelerometer X:
-			jc->accel.x = (float)(uint16_to_int16(packet[13] | (packet[14] << 8) & 0xFF00)) * jc->acc_cal_coeff[0];
-
-			// get accelerometer Y:
-			jc->accel.y = (float)(uint16_to_int16(packet[15] | (packet[16] << 8) & 0xFF00)) * jc->acc_cal_coeff[1];
-
-			// get accelerometer Z:
-			jc->accel.z = (float)(uint16_to_int16(packet[17] | (packet[18] << 8) & 0xFF00)) * jc->acc_cal_coeff[2];
-		}
-
-
-
-		// Gyroscope:
-		// Gyroscope data is relative (rads/s)
-		{
-
-			// get roll:
-			jc->gyro.roll = (float)((uint16_to_int16(packet[19] | (packet[20] << 8) & 0xFF00)) - jc->sensor_cal[1][0]) * jc->gyro_cal_coeff[0];
-
-			// get pitch:
-			jc->gyro.pitch = (float)((uint16_to_int16(packet[21] | (packet[22] << 8) & 0xFF00)) - jc->sensor_cal[1][1]) * jc->gyro_cal_coeff[1];
-
-			// get yaw:
-			jc->gyro.yaw = (float)((uint16_to_int16(packet[23] | (packet[24] << 8) & 0xFF00)) - jc->sensor_cal[1][2]) * jc->gyro_cal_coeff[2];
-		}
-
-		// offsets:
-		{
-			jc->setGyroOffsets();
-
-			jc->gyro.roll -= jc->gyro.offset.roll;
-			jc->gyro.pitch -= jc->gyro.offset.pitch;
-			jc->gyro.yaw -= jc->gyro.offset.yaw;
-
-			//tracker.counter1++;
-			//if (tracker.counter1 > 10) {
-			//	tracker.counter1 = 0;
-			//	printf("%.3f %.3f %.3f\n", abs(jc->gyro.roll), abs(jc->gyro.pitch), abs(jc->gyro.yaw));
-			//}
-		}
-
-
-		//hex_dump(gyro_data, 20);
-
-		if (jc->left_right == 1) {
-			//hex_dump(gyro_data, 20);
-			//hex_dump(packet+12, 20);
-			//printf("x: %f, y: %f, z: %f\n", tracker.anglex, tracker.angley, tracker.anglez);
-			//printf("%04x\n", jc->stick.x);
-			//printf("%f\n", jc->stick.CalX);
-			//printf("%d\n", jc->gyro.yaw);
-			//printf("%02x\n", jc->gyro.roll);
-			//printf("%04x\n", jc->gyro.yaw);
-			//printf("%04x\n", jc->gyro.roll);
-			//printf("%f\n", jc->gyro.roll);
-			//printf("%d\n", accelXA);
-			//printf("%d\n", jc->buttons);
-			//printf("%.4f\n", jc->gyro.pitch);
-			//printf("%04x\n", accelX);
-			//printf("%02x %02x\n", rollA, rollB);
-		}
-
-	}
-
-
-
-
+		// IMU, only full reports have it, 0x21 carries a subcommand reply here:
+		jc->imu_count = state.imuCount;
+		if (state.imuCount) {
 
+			chrono::steady_clock::time_point tNewest = jc->imu_report_time(state.timer, time);
 
-	// handle button combos:
-	{
+			for (int s = 0; s < 3; ++s) {
+				const int16_t *raw = state.imu[s];
+				Joycon::ImuSample &sample = jc->imu[s];
 
-		// press up, down, left, right, L, ZL to restart:
-		if (jc->left_right == 1) {
-			//if (jc->buttons == 207) {
-			//	settings.restart = true;
-			//}
+				sample.time = tNewest - chrono::microseconds(5000 * (2 - s));
 
-			// remove this, it's just for rumble testing
-			//uint8_t hfa2 = 0x88;
-			//uint16_t lfa2 = 0x804d;
+				// Accelerometer data is absolute (m/s^2)
+				sample.accel[0] = raw[0] * jc->acc_cal_coeff[0];
+				sample.accel[1] = raw[1] * jc->acc_cal_coeff[1];
+				sample.accel[2] = raw[2] * jc->acc_cal_coeff[2];
 
-			//tracker.low_freq = clamp(tracker.low_freq, 41.0f, 626.0f);
-			//tracker.high_freq = clamp(tracker.high_freq, 82.0f, 1252.0f);
-			//
-			//// down:
-			//if (jc->buttons == 1) {
-			//	tracker.high_freq -= 1;
-			//	jc->rumble4(tracker.low_freq, tracker.high_freq, hfa2, lfa2);
-			//}
-			//// down:
-			//if (jc->buttons == 2) {
-			//	tracker.high_freq += 1;
-			//	jc->rumble4(tracker.low_freq, tracker.high_freq, hfa2, lfa2);
-			//}
+				// Gyroscope data is relative (rads/s)
+				jc->gyro.roll = (float)(raw[3] - jc->sensor_cal[1][0]) * jc->gyro_cal_coeff[0];
+				jc->gyro.pitch = (float)(raw[4] - jc->sensor_cal[1][1]) * jc->gyro_cal_coeff[1];
+				jc->gyro.yaw = (float)(raw[5] - jc->sensor_cal[1][2]) * jc->gyro_cal_coeff[2];
 
-			//// left:
-			//if (jc->buttons == 8) {
-			//	tracker.low_freq -= 1;
-			//	jc->rumble4(tracker.low_freq, tracker.high_freq, hfa2, lfa2);
-			//}
-			//// right:
-			//if (jc->buttons == 4) {
-			//	tracker.low_freq += 1;
-			//	jc->rumble4(tracker.low_freq, tracker.high_freq, hfa2, lfa2);
-			//}
+				// offsets, every sample counts towards the resting average:
+				jc->setGyroOffsets();
 
-			////printf("%i\n", jc->buttons);
-			////printf("%f\n", tracker.frequency);
-			//printf("%f %f\n", tracker.low_freq, tracker.high_freq);
-		}
-
-
-		// left:
-		if (jc->left_right == 1) {
-			jc->btns.down = (jc->buttons & (1 << 0)) ? 1 : 0;
-			jc->btns.up = (jc->buttons & (1 << 1)) ? 1 : 0;
-			jc->btns.right = (jc->buttons & (1 << 2)) ? 1 : 0;
-			jc->btns.left = (jc->buttons & (1 << 3)) ? 1 : 0;
-			jc->btns.sr = (jc->buttons & (1 << 4)) ? 1 : 0;
-			jc->btns.sl = (jc->buttons & (1 << 5)) ? 1 : 0;
-			jc->btns.l = (jc->buttons & (1 << 6)) ? 1 : 0;
-			jc->btns.zl = (jc->buttons & (1 << 7)) ? 1 : 0;
-			jc->btns.minus = (jc->buttons & (1 << 8)) ? 1 : 0;
-			jc->btns.stick_button = (jc->buttons & (1 << 11)) ? 1 : 0;
-			jc->btns.capture = (jc->buttons & (1 << 13)) ? 1 : 0;
-
-
-			if (/*settings.debugMode*/false) {
-				printf("U: %d D: %d L: %d R: %d LL: %d ZL: %d SB: %d SL: %d SR: %d M: %d C: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
-					jc->btns.up, jc->btns.down, jc->btns.left, jc->btns.right, jc->btns.l, jc->btns.zl, jc->btns.stick_button, jc->btns.sl, jc->btns.sr, \
-					jc->btns.minus, jc->btns.capture, (jc->stick.CalX + 1), (jc->stick.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
+				sample.gyro[0] = jc->gyro.roll - jc->gyro.offset.roll;
+				sample.gyro[1] = jc->gyro.pitch - jc->gyro.offset.pitch;
+				sample.gyro[2] = jc->gyro.yaw - jc->gyro.offset.yaw;
 			}
-			//if (settings.writeDebugToFile) {
-			//	fprintf(settings.outputFile, "U: %d D: %d L: %d R: %d LL: %d ZL: %d SB: %d SL: %d SR: %d M: %d C: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
-			//		jc->btns.up, jc->btns.down, jc->btns.left, jc->btns.right, jc->btns.l, jc->btns.zl, jc->btns.stick_button, jc->btns.sl, jc->btns.sr, \
-			//		jc->btns.minus, jc->btns.capture, (jc->stick.CalX + 1), (jc->stick.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
-			//}
-		}
 
-		// right:
-		if (jc->left_right == 2) {
-			jc->btns.y = (jc->buttons & (1 << 0)) ? 1 : 0;
-			jc->btns.x = (jc->buttons & (1 << 1)) ? 1 : 0;
-			jc->btns.b = (jc->buttons & (1 << 2)) ? 1 : 0;
-			jc->btns.a = (jc->buttons & (1 << 3)) ? 1 : 0;
-			jc->btns.sr = (jc->buttons & (1 << 4)) ? 1 : 0;
-			jc->btns.sl = (jc->buttons & (1 << 5)) ? 1 : 0;
-			jc->btns.r = (jc->buttons & (1 << 6)) ? 1 : 0;
-			jc->btns.zr = (jc->buttons & (1 << 7)) ? 1 : 0;
-			jc->btns.plus = (jc->buttons & (1 << 9)) ? 1 : 0;
-			jc->btns.stick_button = (jc->buttons & (1 << 10)) ? 1 : 0;
-			jc->btns.home = (jc->buttons & (1 << 12)) ? 1 : 0;
-
-
-			if (/*settings.debugMode*/false) {
-				printf("A: %d B: %d X: %d Y: %d RR: %d ZR: %d SB: %d SL: %d SR: %d P: %d H: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
-					jc->btns.a, jc->btns.b, jc->btns.x, jc->btns.y, jc->btns.r, jc->btns.zr, jc->btns.stick_button, jc->btns.sl, jc->btns.sr, \
-					jc->btns.plus, jc->btns.home, (jc->stick.CalX + 1), (jc->stick.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
-			}
-			//if (settings.writeDebugToFile) {
-			//	fprintf(settings.outputFile, "A: %d B: %d X: %d Y: %d RR: %d ZR: %d SB: %d SL: %d SR: %d P: %d H: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
-			//		jc->btns.a, jc->btns.b, jc->btns.x, jc->btns.y, jc->btns.r, jc->btns.zr, jc->btns.stick_button, jc->btns.sl, jc->btns.sr, \
-			//		jc->btns.plus, jc->btns.home, (jc->stick.CalX + 1), (jc->stick.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
-			//}
+			// current state is the newest sample:
+			jc->accel.x = jc->imu[2].accel[0];
+			jc->accel.y = jc->imu[2].accel[1];
+			jc->accel.z = jc->imu[2].accel[2];
+			jc->gyro.roll = jc->imu[2].gyro[0];
+			jc->gyro.pitch = jc->imu[2].gyro[1];
+			jc->gyro.yaw = jc->imu[2].gyro[2];
 		}
 
-		// pro controller:
-		if (jc->left_right == 3) {
-
-			// left:
-			jc->btns.down = (jc->buttons & (1 << 0)) ? 1 : 0;
-			jc->btns.up = (jc->buttons & (1 << 1)) ? 1 : 0;
-			jc->btns.right = (jc->buttons & (1 << 2)) ? 1 : 0;
-			jc->btns.left = (jc->buttons & (1 << 3)) ? 1 : 0;
-			jc->btns.sr = (jc->buttons & (1 << 4)) ? 1 : 0;
-			jc->btns.sl = (jc->buttons & (1 << 5)) ? 1 : 0;
-			jc->btns.l = (jc->buttons & (1 << 6)) ? 1 : 0;
-			jc->btns.zl = (jc->buttons & (1 << 7)) ? 1 : 0;
-			jc->btns.minus = (jc->buttons & (1 << 8)) ? 1 : 0;
-			jc->btns.stick_button = (jc->buttons & (1 << 11)) ? 1 : 0;
-			jc->btns.capture = (jc->buttons & (1 << 13)) ? 1 : 0;
-
-			// right:
-			jc->btns.y = (jc->buttons2 & (1 << 0)) ? 1 : 0;
-			jc->btns.x = (jc->buttons2 & (1 << 1)) ? 1 : 0;
-			jc->btns.b = (jc->buttons2 & (1 << 2)) ? 1 : 0;
-			jc->btns.a = (jc->buttons2 & (1 << 3)) ? 1 : 0;
-			jc->btns.sr = (jc->buttons2 & (1 << 4)) ? 1 : 0;
-			jc->btns.sl = (jc->buttons2 & (1 << 5)) ? 1 : 0;
-			jc->btns.r = (jc->buttons2 & (1 << 6)) ? 1 : 0;
-			jc->btns.zr = (jc->buttons2 & (1 << 7)) ? 1 : 0;
-			jc->btns.plus = (jc->buttons2 & (1 << 9)) ? 1 : 0;
-			jc->btns.stick_button2 = (jc->buttons2 & (1 << 10)) ? 1 : 0;
-			jc->btns.home = (jc->buttons2 & (1 << 12)) ? 1 : 0;
-
-
-			if (/*settings.debugMode*/false) {
-
-				printf("U: %d D: %d L: %d R: %d LL: %d ZL: %d SB: %d SL: %d SR: %d M: %d C: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
-					jc->btns.up, jc->btns.down, jc->btns.left, jc->btns.right, jc->btns.l, jc->btns.zl, jc->btns.stick_button, jc->btns.sl, jc->btns.sr, \
-					jc->btns.minus, jc->btns.capture, (jc->stick.CalX + 1), (jc->stick.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
-
-				printf("A: %d B: %d X: %d Y: %d RR: %d ZR: %d SB: %d SL: %d SR: %d P: %d H: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
-					jc->btns.a, jc->btns.b, jc->btns.x, jc->btns.y, jc->btns.r, jc->btns.zr, jc->btns.stick_button2, jc->btns.sl, jc->btns.sr, \
-					jc->btns.plus, jc->btns.home, (jc->stick2.CalX + 1), (jc->stick2.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
-			}
-
-			//if (settings.writeDebugToFile) {
-			//	fprintf(settings.outputFile, "U: %d D: %d L: %d R: %d LL: %d ZL: %d SB: %d SL: %d SR: %d M: %d C: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
-			//		jc->btns.up, jc->btns.down, jc->btns.left, jc->btns.right, jc->btns.l, jc->btns.zl, jc->btns.stick_button, jc->btns.sl, jc->btns.sr, \
-			//		jc->btns.minus, jc->btns.capture, (jc->stick.CalX + 1), (jc->stick.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
-
-			//	fprintf(settings.outputFile, "A: %d B: %d X: %d Y: %d RR: %d ZR: %d SB: %d SL: %d SR: %d P: %d H: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
-			//		jc->btns.a, jc->btns.b, jc->btns.x, jc->btns.y, jc->btns.r, jc->btns.zr, jc->btns.stick_button2, jc->btns.sl, jc->btns.sr, \
-			//		jc->btns.plus, jc->btns.home, (jc->stick2.CalX + 1), (jc->stick2.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
-			//}
-
+		// button states, bits a controller doesn't have are always 0:
+		uint32_t b = state.buttons;
+		jc->btns.down = (b & JC_DOWN) != 0;
+		jc->btns.up = (b & JC_UP) != 0;
+		jc->btns.right = (b & JC_RIGHT) != 0;
+		jc->btns.left = (b & JC_LEFT) != 0;
+		jc->btns.l = (b & JC_L) != 0;
+		jc->btns.zl = (b & JC_ZL) != 0;
+		jc->btns.minus = (b & JC_MINUS) != 0;
+		jc->btns.capture = (b & JC_CAPTURE) != 0;
+
+		jc->btns.y = (b & JC_Y) != 0;
+		jc->btns.x = (b & JC_X) != 0;
+		jc->btns.b = (b & JC_B) != 0;
+		jc->btns.a = (b & JC_A) != 0;
+		jc->btns.r = (b & JC_R) != 0;
+		jc->btns.zr = (b & JC_ZR) != 0;
+		jc->btns.plus = (b & JC_PLUS) != 0;
+		jc->btns.home = (b & JC_HOME) != 0;
+
+		jc->btns.sr = (b & (JC_SR_L | JC_SR_R)) != 0;
+		jc->btns.sl = (b & (JC_SL_L | JC_SL_R)) != 0;
+		jc->btns.stick_button = (b >> layout.stickButton[0]) & 1;
+		jc->btns.stick_button2 = (b >> layout.stickButton[1]) & 1;
+
+		if (/*settings.debugMode*/false) {
+			printf("U: %d D: %d L: %d R: %d LL: %d ZL: %d SB: %d SL: %d SR: %d M: %d C: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
+				jc->btns.up, jc->btns.down, jc->btns.left, jc->btns.right, jc->btns.l, jc->btns.zl, jc->btns.stick_button, jc->btns.sl, jc->btns.sr, \
+				jc->btns.minus, jc->btns.capture, (jc->stick.CalX + 1), (jc->stick.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
 		}
-
 	}
 }
 
 
-void pollLoop() {
+void processReports() {
 
-	// poll joycons:
+	// handle every queued report, oldest first, so no IMU sample is skipped:
+	HidReport batch[32];
+	Joycon::ImuSample samples[32 * 3];
 	for (int i = 0; i < joycons.size(); ++i) {
+		Joycon *jc = &joycons[i].joycon;
+		int count;
+		while ((count = joycons[i].reports.pop(batch, 32)) > 0) {
+			if (capture.ok()) {
+				capture.reports(i, batch, count);
+			}
 
-		Joycon *jc = &joycons[i];
-
-		if (!jc->handle) { continue; }
-
-		if (/*settings.forcePollUpdate*/false) {
-			// set to be blocking:
-			hid_set_nonblocking(jc->handle, 0);
-		} else {
-			// set to be non-blocking:
-			hid_set_nonblocking(jc->handle, 1);
-		}
-
-		// get input:
-		memset(buf, 0, 65);
-
-		// get current time
-		chrono::high_resolution_clock::time_point tNow = chrono::high_resolution_clock::now();
-
-		auto timeSincePoll = std::chrono::duration_cast<std::chrono::microseconds>(tNow - tracker.tPolls[i]);
-
-		// time spent sleeping (0):
-		double timeSincePollMS = timeSincePoll.count() / 1000.0;
-
-		if (timeSincePollMS > (1000.0 / /*settings.pollsPerSec*/60.0f)) {
-			jc->send_command(0x1E, buf, 0);
-			tracker.tPolls[i] = chrono::high_resolution_clock::now();
-		}
-
-
-		hid_read(jc->handle, buf, 0x40);
+			int sampleCount = 0;
+			for (int j = 0; j < count; ++j) {
+				handle_input(jc, batch[j].data, batch[j].length, batch[j].time);
+				for (int s = 0; s < jc->imu_count; ++s) {
+					samples[sampleCount++] = jc->imu[s];
+				}
+			}
 
-		// get rid of queue:
-		// if we force the poll to wait then the queue will never clear and will just freeze:
-		if (/*!settings.forcePollUpdate*/true) {
-			while (hid_read(jc->handle, buf, 0x40) > 0) {};
+			// fuse the whole batch at once:
+			jc->orientation.update(samples, sampleCount);
 		}
-
-		handle_input(jc, buf, 0x40);
 	}
 
+	if (joycons.size() == 0) { return; }
+
 	// DO STUFF WITH JOYCONS HERE:
 
 	// get first connected joycon:
-	Joycon *jc = &joycons[0];
+	Joycon *jc = &joycons[0].joycon;
 
 	// left joycon:
 					printf("U: %d D: %d L: %d R: %d LL: %d ZL: %d SB: %d SL: %d SR: %d M: %d C: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
 					jc->btns.up, jc->btns.down, jc->btns.left, jc->btns.right, jc->btns.l, jc->btns.zl, jc->btns.stick_button, jc->btns.sl, jc->btns.sr, \
 					jc->btns.minus, jc->btns.capture, (jc->stick.CalX + 1), (jc->stick.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
 
+	// orientation:
+	const Quaternion &q = jc->orientation.orientation();
+	printf("QW: %.4f QX: %.4f QY: %.4f QZ: %.4f\n", q.w, q.x, q.y, q.z);
+
 	// right joycon:
 	//				printf("A: %d B: %d X: %d Y: %d RR: %d ZR: %d SB: %d SL: %d SR: %d P: %d H: %d SX: %.5f SY: %.5f GR: %06d GP: %06d GY: %06d\n", \
 					jc->btns.a, jc->btns.b, jc->btns.x, jc->btns.y, jc->btns.r, jc->btns.zr, jc->btns.stick_button, jc->btns.sl, jc->btns.sr, \
 					jc->btns.plus, jc->btns.home, (jc->stick.CalX + 1), (jc->stick.CalY + 1), (int)jc->gyro.roll, (int)jc->gyro.pitch, (int)jc->gyro.yaw);
 
-	// sleep:
-	usleep(2000);// 8.00
 }
 
 void start() {
@@ -447,16 +213,8 @@ void start() {
 	int written;// number of bytes written
 	const char *device_name;
 
-	// Enumerate and print the HID devices on the system
-	struct hid_device_info *devs, *cur_dev;
-
 	res = hid_init();
 
-	// hack:
-	for (int i = 0; i < 100; ++i) {
-		tracker.tPolls.push_back(std::chrono::high_resolution_clock::now());
-	}
-
 
 	if (/*settings.writeDebugToFile*/false) {
 
@@ -474,105 +232,269 @@ void start() {
 
 init_start:
 
-	devs = hid_enumerate(JOYCON_VENDOR, 0x0);
-	cur_dev = devs;
-	while (cur_dev) {
+	// find and init joycons:
+	joycons.open();
+	joycons.initialize(/*settings.usingGrip*/false);
 
-		// identify by vendor:
-		if (cur_dev->vendor_id == JOYCON_VENDOR) {
-
-			// bluetooth, left / right joycon:
-			if (cur_dev->product_id == JOYCON_L_BT || cur_dev->product_id == JOYCON_R_BT) {
-				Joycon jc = Joycon(cur_dev);
-				joycons.push_back(jc);
-			}
+	// initial poll to get battery data:
+	joycons.pollOnce();
+	processReports();
+	for (int i = 0; i < joycons.size(); ++i) {
+		printf("battery level: %u\n", joycons[i].joycon.battery);
+	}
 
-			// pro controller:
-			if (cur_dev->product_id == PRO_CONTROLLER) {
-				Joycon jc = Joycon(cur_dev);
-				joycons.push_back(jc);
+	// set lights, retried until acknowledged:
+	printf("setting LEDs...\n");
+	for (int i = 0; i < joycons.size(); ++i) {
+		JoyconDevice *device = &joycons[i];
+		Joycon *jc = &device->joycon;
+		SubcommandEngine engine(jc->handle, jc->global_count, [device](const HidReport &report) {
+			device->reports.push(report);
+		});
+		// Player LED Enable
+		unsigned char buf[0x40];
+		memset(buf, 0x00, 0x40);
+		if (i == 0) {
+			buf[0] = 0x0 | 0x0 | 0x0 | 0x1;		// solid 1
+		}
+		if (i == 1) {
+			if (/*settings.combineJoyCons*/true) {
+				buf[0] = 0x0 | 0x0 | 0x0 | 0x1; // solid 1
+			} else if (/*!settings.combineJoyCons*/false) {
+				buf[0] = 0x0 | 0x0 | 0x2 | 0x0; // solid 2
 			}
+		}
+		//buf[0] = 0x80 | 0x40 | 0x2 | 0x1; // Flash top two, solid bottom two
+		//buf[0] = 0x8 | 0x4 | 0x2 | 0x1; // All solid
+		//buf[0] = 0x80 | 0x40 | 0x20 | 0x10; // All flashing
+		//buf[0] = 0x80 | 0x00 | 0x20 | 0x10; // All flashing except 3rd light (off)
+		engine.submit(0x30, buf, 1, 0, nullptr);
+		engine.run();
+	}
 
-			// charging grip:
-			//if (cur_dev->product_id == JOYCON_CHARGING_GRIP) {
-			//	Joycon jc = Joycon(cur_dev);
-			//	settings.usingBluetooth = false;
-			//	settings.combineJoyCons = true;
-			//	joycons.push_back(jc);
-			//}
 
+	// give a small rumble to all joycons:
+	printf("vibrating JoyCon(s).\n");
+	for (int k = 0; k < 1; ++k) {
+		for (int i = 0; i < joycons.size(); ++i) {
+			joycons[i].joycon.rumble(100, 1);
+			usleep(20000);
+			joycons[i].joycon.rumble(10, 3);
 		}
+	}
 
+	// the commands above read the devices themselves, only start reading now:
+	joycons.start();
 
-		cur_dev = cur_dev->next;
+	printf("Done.\n");
+}
+
+
+
+
+// Feeds a capture through handle_input() and fusion, as fast as possible or
+// at the recorded pace, and reports the throughput.
+int replay(const char *path, bool realtime) {
+
+	HidCaptureReader reader;
+	if (!reader.open(path)) {
+		return 1;
 	}
-	hid_free_enumeration(devs);
 
+	struct ReplayDevice {
+		Joycon jc;
+		long long reports = 0;
+		long long samples = 0;
+		int64_t firstTime = 0;
+		int64_t lastTime = 0;
+		int64_t maxInterval = 0;
+	};
+	std::vector<std::unique_ptr<ReplayDevice>> devices;
+
+	PreciseSleeper sleeper;
+	chrono::steady_clock::time_point tStart = chrono::steady_clock::now();
+	int64_t captureStart = -1;
+	long long total = 0;
+
+	const CaptureRecord *record;
+	const uint8_t *payload;
+	while (reader.next(record, payload)) {
+
+		if (record->type == CAPTURE_DEVICE && record->length >= sizeof(CaptureDevice)) {
+			if (devices.size() <= record->device) {
+				devices.resize(record->device + 1);
+			}
+			devices[record->device].reset(new ReplayDevice());
+
+			CaptureDevice device;
+			memcpy(&device, payload, sizeof(device));
+			device.to(devices[record->device]->jc);
+			printf("replaying %s %s\n", device.name, device.serial);
+			continue;
+		}
 
+		if (record->type != CAPTURE_REPORT || record->device >= devices.size() || !devices[record->device]) {
+			continue;
+		}
+		ReplayDevice &device = *devices[record->device];
 
-	// init joycons:
-	if (/*settings.usingGrip*/false) {
-		for (int i = 0; i < joycons.size(); ++i) {
-			joycons[i].init_usb();
+		if (captureStart < 0) {
+			captureStart = record->time;
 		}
-	} else {
-		for (int i = 0; i < joycons.size(); ++i) {
-			joycons[i].init_bt();
+		if (realtime) {
+			sleeper.sleepUntil(tStart + chrono::nanoseconds(record->time - captureStart));
 		}
-	}
 
-	// initial poll to get battery data:
-	pollLoop();
-	for (int i = 0; i < joycons.size(); ++i) {
-		printf("battery level: %u\n", joycons[i].battery);
-	}
+		// decoders may look past short reports:
+		uint8_t packet[0x40];
+		int length = std::min((int)record->length, 0x40);
+		memcpy(packet, payload, length);
+		memset(packet + length, 0, sizeof(packet) - length);
 
-	// set lights:
-	printf("setting LEDs...\n");
-	for (int r = 0; r < 5; ++r) {
-		for (int i = 0; i < joycons.size(); ++i) {
-			Joycon *jc = &joycons[i];
-			// Player LED Enable
-			memset(buf, 0x00, 0x40);
-			if (i == 0) {
-				buf[0] = 0x0 | 0x0 | 0x0 | 0x1;		// solid 1
-			}
-			if (i == 1) {
-				if (/*settings.combineJoyCons*/true) {
-					buf[0] = 0x0 | 0x0 | 0x0 | 0x1; // solid 1
-				} else if (/*!settings.combineJoyCons*/false) {
-					buf[0] = 0x0 | 0x0 | 0x2 | 0x0; // solid 2
-				}
-			}
-			//buf[0] = 0x80 | 0x40 | 0x2 | 0x1; // Flash top two, solid bottom two
-			//buf[0] = 0x8 | 0x4 | 0x2 | 0x1; // All solid
-			//buf[0] = 0x80 | 0x40 | 0x20 | 0x10; // All flashing
-			//buf[0] = 0x80 | 0x00 | 0x20 | 0x10; // All flashing except 3rd light (off)
-			jc->send_subcommand(0x01, 0x30, buf, 1);
+		chrono::steady_clock::time_point time{ chrono::nanoseconds(record->time) };
+		handle_input(&device.jc, packet, length, time);
+		device.jc.orientation.update(device.jc.imu, device.jc.imu_count);
+
+		if (device.reports > 0) {
+			device.maxInterval = std::max(device.maxInterval, record->time - device.lastTime);
+		} else {
+			device.firstTime = record->time;
 		}
+		device.lastTime = record->time;
+		device.reports++;
+		device.samples += device.jc.imu_count;
+		total++;
 	}
 
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+	printf("%lld reports in %.3f s: %.0f reports/s, %.1f ns/report\n", total, seconds, total / seconds, seconds * 1e9 / std::max(total, 1LL));
+
+	for (size_t i = 0; i < devices.size(); ++i) {
+		if (!devices[i] || devices[i]->reports == 0) continue;
+		ReplayDevice &device = *devices[i];
+		double span = (device.lastTime - device.firstTime) / 1e6;
+		const Quaternion &q = device.jc.orientation.orientation();
+		printf("%d %s: %lld reports, %lld IMU samples, interval mean %.2f ms max %.2f ms, final QW: %.4f QX: %.4f QY: %.4f QZ: %.4f\n",
+			(int)i, device.jc.name.c_str(), device.reports, device.samples,
+			device.reports > 1 ? span / (device.reports - 1) : 0.0, device.maxInterval / 1e6, q.w, q.x, q.y, q.z);
+	}
 
-	// give a small rumble to all joycons:
-	printf("vibrating JoyCon(s).\n");
-	for (int k = 0; k < 1; ++k) {
-		for (int i = 0; i < joycons.size(); ++i) {
-			joycons[i].rumble(100, 1);
-			usleep(20000);
-			joycons[i].rumble(10, 3);
+	return 0;
+}
+
+
+// Times DecodeReports() alone over the reports of a capture, packed 0x40
+// bytes apart per device, and prints the cost per report.
+int benchDecode(const char *path) {
+
+	HidCaptureReader reader;
+	if (!reader.open(path)) {
+		return 1;
+	}
+
+	struct BenchDevice {
+		int left_right = 0;
+		std::vector<uint8_t> reports;
+	};
+	std::vector<BenchDevice> devices;
+
+	const CaptureRecord *record;
+	const uint8_t *payload;
+	while (reader.next(record, payload)) {
+		if (devices.size() <= record->device) {
+			devices.resize(record->device + 1);
+		}
+		BenchDevice &device = devices[record->device];
+
+		if (record->type == CAPTURE_DEVICE && record->length >= sizeof(CaptureDevice)) {
+			CaptureDevice captured;
+			memcpy(&captured, payload, sizeof(captured));
+			device.left_right = captured.left_right;
+		} else if (record->type == CAPTURE_REPORT) {
+			// zero padded like a read into a full buffer:
+			size_t offset = device.reports.size();
+			device.reports.resize(offset + 0x40, 0);
+			memcpy(&device.reports[offset], payload, std::min((int)record->length, 0x40));
 		}
 	}
 
-	printf("Done.\n");
+	long long total = 0;
+	double totalSeconds = 0;
+	uint32_t checksum = 0;
+	for (size_t i = 0; i < devices.size(); ++i) {
+		BenchDevice &device = devices[i];
+		int count = (int)(device.reports.size() / 0x40);
+		if (count == 0) continue;
+
+		const JoyconLayout &layout = JOYCON_LAYOUTS[device.left_right & 3];
+		std::vector<JoyconState> states(count);
+
+		// repeat the whole backlog until the timing is well above clock resolution:
+		long long decoded = 0;
+		chrono::steady_clock::time_point tStart = chrono::steady_clock::now();
+		double seconds = 0;
+		do {
+			DecodeReports(layout, &device.reports[0], 0x40, count, &states[0]);
+			checksum += states[count - 1].buttons + states[count - 1].stick[0][0] + states[count - 1].timer;
+			decoded += count;
+			seconds = chrono::duration<double>(chrono::steady_clock::now() - tStart).count();
+		} while (seconds < 0.2);
+
+		printf("%d: %d reports, %.2f ns/report\n", (int)i, count, seconds * 1e9 / decoded);
+		total += decoded;
+		totalSeconds += seconds;
+	}
+
+	printf("decoded %lld reports, %.2f ns/report (checksum %u)\n", total, totalSeconds * 1e9 / std::max(total, 1LL), checksum);
+	return 0;
 }
 
 
+int main(int argc, char *argv[]) {
 
+	// Test [--capture file] | [--replay file [--realtime]] | [--bench-decode file]
+	const char *capturePath = nullptr;
+	const char *replayPath = nullptr;
+	const char *benchPath = nullptr;
+	bool realtime = false;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--capture") && i + 1 < argc) {
+			capturePath = argv[++i];
+		} else if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+			replayPath = argv[++i];
+		} else if (!strcmp(argv[i], "--bench-decode") && i + 1 < argc) {
+			benchPath = argv[++i];
+		} else if (!strcmp(argv[i], "--realtime")) {
+			realtime = true;
+		}
+	}
+
+	if (replayPath) {
+		return replay(replayPath, realtime);
+	}
+	if (benchPath) {
+		return benchDecode(benchPath);
+	}
 
-int main(int argc, char *argv[]) {
 	start();
+
+	// log every raw report from now on:
+	if (capturePath && capture.open(capturePath)) {
+		for (int i = 0; i < joycons.size(); ++i) {
+			capture.device(i, joycons[i].joycon);
+		}
+		printf("capturing to %s\n", capturePath);
+	}
+
+	// consume input at 60 fps, the reader thread keeps everything in between:
+	PreciseSleeper sleeper;
+	PeriodicDeadline frame(chrono::microseconds(1000000 / 60));
 	while (true) {
-		pollLoop();
+		processReports();
+		frame.advance(chrono::steady_clock::now());
+		sleeper.sleepUntil(frame.next);
 	}
+
+	joycons.stop();
 	return 0;
 }
@@ -21,11 +21,14 @@
         http://github.com/signal11/hidapi .
 ********************************************************/
 
+#pragma once
+
 /* C */
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <locale.h>
+#include <wchar.h>
 #include <errno.h>
 
 /* Unix */
@@ -762,6 +765,11 @@ int hid_read(hid_device *dev, unsigned char *data, size_t length)
 	return hid_read_timeout(dev, data, length, (dev->blocking)? -1: 0);
 }
 
+int hid_get_fd(hid_device *dev)
+{
+	return dev->device_handle;
+}
+
 int hid_set_nonblocking(hid_device *dev, int nonblock)
 {
 	/* Do all non-blocking in userspace using poll(), since it looks
@@ -372,6 +372,21 @@ extern "C" {
 		*/
 		int HID_API_EXPORT_CALL hid_get_indexed_string(hid_device *device, int string_index, wchar_t *string, size_t maxlen);
 
+		/** @brief Get the file descriptor of an open device.
+
+			The descriptor is owned by the device and stays valid until
+			hid_close(). It is readable whenever an input report is
+			queued, so it can be waited on with poll()/epoll together
+			with other devices. Linux hidraw backend only.
+
+			@ingroup API
+			@param device A device handle returned from hid_open().
+
+			@returns
+				The hidraw file descriptor of the device.
+		*/
+		int HID_API_EXPORT_CALL hid_get_fd(hid_device *device);
+
 		/** @brief Get a string describing the last error which occurred.
 
 			@ingroup API
@@ -1,6 +1,10 @@
 #pragma once
 #include <chrono>
+#include <random>
 #include <thread>
+#include <algorithm>
+#include <errno.h>
+#include <time.h>
 #include <map>
 #include <string>
 #include <iostream>
@@ -69,38 +73,73 @@ int rand_range(int min, int max) {
 
 }*/
 
-// sleeps very accurately:
-void veryAccurateSleep(double durationMS) {
+// Sleeps until an absolute steady_clock time. The kernel sleep is aimed
+// spinMargin early and only that tail is spun. The margin follows how late
+// clock_nanosleep has actually been waking this process, so it stays just
+// big enough to hide the wakeup latency.
+class PreciseSleeper {
+
+public:
+
+	void sleepUntil(std::chrono::steady_clock::time_point deadline) {
+		using namespace std::chrono;
+
+		steady_clock::time_point wake = deadline - this->spinMargin;
+		if (steady_clock::now() < wake) {
+			// steady_clock is CLOCK_MONOTONIC on Linux:
+			nanoseconds since = duration_cast<nanoseconds>(wake.time_since_epoch());
+			struct timespec ts;
+			ts.tv_sec = (time_t)(since.count() / 1000000000);
+			ts.tv_nsec = (long)(since.count() % 1000000000);
+			while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+
+			// track the wakeup latency, margin is twice its running average:
+			nanoseconds late = steady_clock::now() - wake;
+			this->lateness += (late - this->lateness) / 8;
+			this->spinMargin = std::min(std::max(this->lateness * 2, nanoseconds(10000)), nanoseconds(1000000));
+		}
 
-	// get current time
-	auto tNow = std::chrono::high_resolution_clock::now();
+		// spin the tail:
+		while (steady_clock::now() < deadline) {}
+	}
 
-	auto tSleepStart = std::chrono::high_resolution_clock::now();
+	void sleepFor(double durationMS) {
+		sleepUntil(std::chrono::steady_clock::now() + std::chrono::microseconds((long long)(durationMS * 1000.0)));
+	}
 
-	auto tSleepDuration = std::chrono::duration_cast<std::chrono::microseconds>(tNow - tSleepStart);
+private:
 
-	// get the application's runtime duration in ms
-	//runningTimeMS = std::chrono::duration_cast<std::chrono::milliseconds>(tNow - tApplicationStart).count();
-	//auto tFrameDuration = std::chrono::duration_cast<std::chrono::microseconds>(tNow - tFrameStart);
-	//double tFrameDurationMS = tFrameDuration.count() / 1000.0;
+	std::chrono::nanoseconds spinMargin{ 50000 };
+	std::chrono::nanoseconds lateness{ 25000 };
+};
 
+// A periodic task's next due time. Deadlines advance by whole periods from
+// the first one, so late handling never shifts the schedule; periods missed
+// entirely are skipped rather than run back to back.
+struct PeriodicDeadline {
 
-	// time spent sleeping (0):
-	double tSleepTimeMS = tSleepDuration.count() / 1000.0;
+	std::chrono::steady_clock::duration period;
+	std::chrono::steady_clock::time_point next;
 
-	//float lowerThres = 0.2;
-	//float sleepThreshold = 1.8;//1.4
+	PeriodicDeadline(std::chrono::steady_clock::duration period, std::chrono::steady_clock::time_point first = std::chrono::steady_clock::now()) :
+		period(period), next(first) {}
 
-	// run cpu in circles
-	while (tSleepTimeMS < durationMS) {
-		
-		// never sleep, burn the CPU
-		tNow = std::chrono::high_resolution_clock::now();
-		tSleepDuration = std::chrono::duration_cast<std::chrono::microseconds>(tNow - tSleepStart);
-		tSleepTimeMS = tSleepDuration.count() / 1000.0;
+	bool due(std::chrono::steady_clock::time_point now) const {
+		return now >= this->next;
+	}
+
+	void advance(std::chrono::steady_clock::time_point now) {
+		this->next += this->period;
+		if (this->next <= now) {
+			this->next += this->period * ((now - this->next) / this->period + 1);
+		}
 	}
+};
 
-	// done "sleeping"
+// sleeps very accurately, without burning the CPU for the whole duration:
+void veryAccurateSleep(double durationMS) {
+	static PreciseSleeper sleeper;
+	sleeper.sleepFor(durationMS);
 }
 
 
@@ -1,5 +1,7 @@
 #include "Geometry.h"
+#include "boilerplate/BSpline.h"
 #include <iostream>
+#include <algorithm>
 
 #include <cmath>
 
@@ -11,83 +13,133 @@ Geometry::Geometry() {
 	modelMatrix = glm::mat4(1.f);
 }
 
+//Value of basis function index1 of order index2 at iterator, using the
+//non-recursive Cox-de Boor from BSpline.h. The span has to have index2-1
+//knots on either side, which holds for the range E_delta_1 samples.
 double Geometry::delta(std::vector<double> &uVector, double iterator, int index1, int index2){
-    if(index2==1)
-    {
-        if(uVector[index1]<=iterator && iterator<uVector[index1+1])
-            return 1;
+    if(iterator < uVector[index1] || iterator >= uVector[index1+index2])
         return 0;
+    int span = std::upper_bound(uVector.begin(), uVector.end(), iterator) - uVector.begin() - 1;
+    if(span-index2+1 < 0 || span+index2-1 >= (int)uVector.size())
+        return 0;
+    std::vector<double> basis(index2), left(index2), right(index2);
+    BSplineBasis(&uVector[0], span, iterator, index2, &basis[0], &left[0], &right[0]);
+    return basis[index1-(span-index2+1)];
+}
+
+//Clamped B-spline of the polygon (polyx[i], polyy[i]): both ends are repeated
+//order extra times on uniform knots so the curve starts and ends on them.
+//It is sampled wherever u = i*uStep lands in the valid range.
+static void clampedKnots(int count, int order, std::vector<double> &knots) {
+    int n = count + 2*order;
+    knots.resize(n + order);
+    for (int i = 0; i < n + order; i++)
+        knots[i] = ((double)i)/(n + order - 1);
+}
+
+static void clampedRange(const std::vector<double> &knots, int count, int order, double uStep, int *first, int *samples) {
+    int n = count + 2*order;
+    *first = (int)ceil(knots[order-1] / uStep);
+    int last = (int)floor(knots[n] / uStep);
+    *samples = std::max(0, last - *first + 1);
+}
+
+int Geometry::clampedBSplineSamples(int count, int order, double uStep) {
+    if (count <= 0 || order <= 0) return 0;
+    std::vector<double> knots;
+    clampedKnots(count, order, knots);
+    int first, samples;
+    clampedRange(knots, count, order, uStep, &first, &samples);
+    return samples;
+}
+
+//out must have room for clampedBSplineSamples(count, order, uStep) points
+void Geometry::clampedBSpline(const int *polyx, const int *polyy, int count, int order, double uStep, glm::vec3 *out) {
+    if (count <= 0 || order <= 0) return;
+    std::vector<double> knots;
+    clampedKnots(count, order, knots);
+    int first, samples;
+    clampedRange(knots, count, order, uStep, &first, &samples);
+
+    std::vector<glm::dvec2> controls(count + 2*order);
+    for (int i = 0; i < (int)controls.size(); i++) {
+        int j = std::min(std::max(i - order, 0), count - 1);
+        controls[i] = glm::dvec2(polyx[j], polyy[j]);
+    }
+
+    //evaluated in double a block at a time, then narrowed into out
+    const int BLOCK = 256;
+    glm::dvec2 block[BLOCK];
+    for (int done = 0; done < samples; done += BLOCK) {
+        int size = std::min(BLOCK, samples - done);
+        SampleBSpline<2, double>(order, &controls[0], controls.size(), &knots[0], (first + done) * uStep, uStep, size, block);
+        for (int i = 0; i < size; i++)
+            out[done + i] = glm::vec3(block[i].x, block[i].y, 0);
     }
-    double delted;
-    delted = ((iterator-uVector[index1])/(uVector[index1+index2-1]-uVector[index1])*delta(uVector, iterator, index1, index2-1)) + ((uVector[index1+index2]-iterator)/(uVector[index1+index2]-uVector[index1+1])*delta(uVector, iterator, index1+1, index2-1));
-    return delted;
 }
 
-Geometry Geometry::E_delta_1(std::vector<int> polyx, std::vector<int> polyy, int factor)
+Geometry Geometry::E_delta_1(const std::vector<int> &polyx, const std::vector<int> &polyy, int factor)
 {
     Geometry curve;
-    int n, d;
-    d = factor;
-    std::vector<int> xcopy;
-    xcopy.swap(polyx);
-    std::vector<int> ycopy;
-    ycopy.swap(polyy);
-    for(int index = 0; index < d; index ++){
-        xcopy.insert(xcopy.begin(), xcopy[0]);
-        ycopy.insert(ycopy.begin(), ycopy[0]);
-        xcopy.insert(xcopy.end(), xcopy[xcopy.size()-1]);
-        ycopy.insert(ycopy.end(), ycopy[ycopy.size()-1]);
-    }
-    n = xcopy.size();
-    std::vector<double> uVec;
-    int i;
-    for(i=0;i<n+d;i++)
-    {
-        uVec.push_back(((double)i)/(n+d-1));
-    }
-    double x, y, basis, u;
-    for(u=0;u<=1;u+=0.0001)
-    {
-        if (u >= (uVec[d-1]) && u <= (uVec[n])){
-            x = 0;
-            y = 0;
-            for(i=0;i<xcopy.size();i++)
-            {
-                basis = Geometry::delta(uVec, u, i, d);
-                x += basis*xcopy[i];
-                y += basis*ycopy[i];
-            }
-            curve.verts.push_back(glm::vec3(x, y, 0));
-            curve.colours.push_back(glm::vec3(1.f, 0.f, 0.f));
-        }
-    }
+    double uStep = 0.0001;
+    int samples = clampedBSplineSamples(polyx.size(), factor, uStep);
+    curve.verts.resize(samples);
+    clampedBSpline(polyx.data(), polyy.data(), polyx.size(), factor, uStep, curve.verts.data());
+    curve.colours.assign(samples, glm::vec3(1.f, 0.f, 0.f));
     curve.drawMode = GL_LINE_STRIP;
     return curve;
 }
 
 
+//Parametric curves are sampled at u = i*uInc for i < count. cos/sin of each
+//angle come from rotating the previous one by the fixed step (a complex
+//multiply), with an exact cos/sin every ANGLE_RESEED samples so rounding
+//does not build up along long curves.
+static const int ANGLE_RESEED = 256;
+
+static int sampleCount(double range, double uInc) {
+    return (int)(range / uInc) + 1;
+}
+
+//out[i] = (cos, sin) of frequency * i * uInc
+static void sampleAngles(double frequency, double uInc, int count, std::vector<glm::dvec2> &out) {
+    out.resize(count);
+    double step = frequency * uInc;
+    glm::dvec2 rotate(cos(step), sin(step));
+    for (int i = 0; i < count; i++) {
+        if (i % ANGLE_RESEED == 0) {
+            out[i] = glm::dvec2(cos(step * i), sin(step * i));
+        } else {
+            glm::dvec2 prev = out[i-1];
+            out[i] = glm::dvec2(prev.x * rotate.x - prev.y * rotate.y, prev.x * rotate.y + prev.y * rotate.x);
+        }
+    }
+}
+
 Geometry Geometry::makeCircle(float radius, float uInc) {
 
 	Geometry circle;
+	std::vector<glm::dvec2> angles;
+	sampleAngles(1.0, uInc, sampleCount(2.0 * M_PI, uInc), angles);
 
-	for (double u = 0.0; u <= 2.0 * M_PI; u += uInc) {
-		circle.verts.push_back(radius * glm::vec3(cos(u), sin(u), 0));
-		circle.colours.push_back(glm::vec3(1.f, 1.f, 1.f));
-	}
+	circle.verts.resize(angles.size());
+	for (unsigned int i = 0; i < angles.size(); i++)
+		circle.verts[i] = radius * glm::vec3(angles[i].x, angles[i].y, 0);
+	circle.colours.assign(angles.size(), glm::vec3(1.f, 1.f, 1.f));
 	circle.drawMode = GL_LINE_STRIP;
 	return circle;
 }
 Geometry Geometry::makeSmolCircle(float radius, float uInc, double x, double y) {
     
     Geometry circle;
+    std::vector<glm::dvec2> angles;
+    sampleAngles(1.0, uInc, sampleCount(2.0 * M_PI, uInc), angles);
     
-    for (double u = 0.0; u <= 2.0 * M_PI; u += uInc) {
-        glm::vec3 circlePoint =  radius * glm::vec3(cos(u), sin(u) , 0);
-        circlePoint = circlePoint + glm::vec3(x, y , 0);
-//        std::cout << circlePoint.x  << std::endl;
-        circle.verts.push_back(circlePoint);
-        circle.colours.push_back(glm::vec3(0.f, 0.f, 0.f));
-    }
+    glm::vec3 centre(x, y, 0);
+    circle.verts.resize(angles.size());
+    for (unsigned int i = 0; i < angles.size(); i++)
+        circle.verts[i] = radius * glm::vec3(angles[i].x, angles[i].y, 0) + centre;
+    circle.colours.assign(angles.size(), glm::vec3(0.f, 0.f, 0.f));
     circle.drawMode = GL_LINE_STRIP;
     return circle;
 }
@@ -96,18 +148,24 @@ Geometry Geometry::makeSmolCircle(float radius, float uInc, double x, double y)
 Geometry Geometry::makeHypocycloid(float smolRadius, float bigRadius, int cycle, float rotation, float scale, float uInc){
     Geometry hypo;
     
-    for (double u = 0.0; u <= cycle * 2.0 * M_PI; u += uInc) {
-        float test1 = (bigRadius - smolRadius) * cos(u);
-        float test2 =(smolRadius * cos(((bigRadius- smolRadius)/ smolRadius)* u));
-        float x = scale * (test1 + test2);
-        float y = scale * (((bigRadius - smolRadius)* sin(u)) - (smolRadius * sin(((bigRadius- smolRadius)/ smolRadius)* u)));
-        glm::mat3 rot = glm::mat3(cos(rotation) , sin(rotation), 0,
-                                  -sin(rotation), cos(rotation), 0,
-                                  0,0,1);
-        glm::vec3 vec = rot *  glm::vec3(x, y, 0);
-        hypo.verts.push_back(vec);
-        hypo.colours.push_back(glm::vec3(0.f, 1.f, 0.f));
+    //the rolling circle turns (R-r)/r times per turn around the big one
+    int count = sampleCount(cycle * 2.0 * M_PI, uInc);
+    std::vector<glm::dvec2> outer, inner;
+    sampleAngles(1.0, uInc, count, outer);
+    sampleAngles((bigRadius - smolRadius) / smolRadius, uInc, count, inner);
+    
+    //scale and rotation are the same for every sample
+    float a = scale * (bigRadius - smolRadius);
+    float b = scale * smolRadius;
+    float c = cos(rotation), s = sin(rotation);
+    
+    hypo.verts.resize(count);
+    for (int i = 0; i < count; i++) {
+        float x = a * outer[i].x + b * inner[i].x;
+        float y = a * outer[i].y - b * inner[i].y;
+        hypo.verts[i] = glm::vec3(c * x - s * y, s * x + c * y, 0);
     }
+    hypo.colours.assign(count, glm::vec3(0.f, 1.f, 0.f));
     hypo.drawMode = GL_LINE_STRIP;
     return hypo;
 }
@@ -0,0 +1,56 @@
+#include "ArcLength.h"
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+ArcLength::ArcLength(const vector<vec2> &curve):points(curve){
+	cumulative.resize(points.size());
+	float total = 0.f;
+	for(unsigned int i = 0; i < points.size(); i++){
+		if(i > 0) total += distance(points[i-1], points[i]);
+		cumulative[i] = total;
+	}
+}
+
+float ArcLength::length() const{
+	return cumulative.empty() ? 0.f : cumulative.back();
+}
+
+//point at distance s inside the segment starting at points[segment]
+vec2 ArcLength::interpolate(unsigned int segment, float s) const{
+	float span = cumulative[segment+1] - cumulative[segment];
+	float t = span > 0.f ? (s - cumulative[segment])/span : 0.f;
+	return mix(points[segment], points[segment+1], t);
+}
+
+vec2 ArcLength::point_at(float s) const{
+	if(points.empty()) return vec2(0.f);
+	if(points.size() == 1 || s <= 0.f) return points.front();
+	if(s >= length()) return points.back();
+
+	//first entry past s, the segment ends there
+	unsigned int end = upper_bound(cumulative.begin(), cumulative.end(), s) - cumulative.begin();
+	return interpolate(end-1, s);
+}
+
+void ArcLength::resample(vector<vec2> *out, unsigned int count) const{
+	out->clear();
+	if(points.empty() || count == 0) return;
+	out->reserve(count);
+	if(points.size() == 1 || count == 1){
+		out->assign(count, points.front());
+		return;
+	}
+
+	float step = length()/(float)(count-1);
+	unsigned int segment = 0;
+	for(unsigned int i = 0; i < count-1; i++){
+		float s = step*i;
+		while(segment+2 < points.size() && cumulative[segment+1] < s)
+			segment++;
+		out->push_back(interpolate(segment, s));
+	}
+	//exact end point rather than accumulated rounding
+	out->push_back(points.back());
+}
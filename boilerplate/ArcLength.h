@@ -0,0 +1,23 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+//Cumulative arc length table over a polyline, built once.
+//Lets a curve be sampled by distance travelled instead of by point index.
+class ArcLength{
+public:
+	std::vector<glm::vec2> points;
+	std::vector<float> cumulative;	//cumulative[i] is the length from points[0] to points[i]
+
+	ArcLength(const std::vector<glm::vec2> &curve);
+
+	float length() const;
+	glm::vec2 point_at(float s) const;	//Binary search, s is clamped to [0, length()]
+
+	//count points evenly spaced by arc length, both ends included.
+	//Walks the table forward instead of searching since s only increases.
+	void resample(std::vector<glm::vec2> *out, unsigned int count) const;
+
+private:
+	glm::vec2 interpolate(unsigned int segment, float s) const;
+};
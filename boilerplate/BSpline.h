@@ -0,0 +1,115 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <algorithm>
+#include <vector>
+
+//Control point type for a spline of the given dimension and precision
+template <int Dim, typename Scalar> struct SplinePoint;
+template <typename Scalar> struct SplinePoint<2, Scalar>{ typedef glm::tvec2<Scalar, glm::highp> type; };
+template <typename Scalar> struct SplinePoint<3, Scalar>{ typedef glm::tvec3<Scalar, glm::highp> type; };
+
+//Non-recursive Cox-de Boor: the order nonzero basis functions on span
+//[knots[span], knots[span+1]) at u, N[r] belongs to control point span-order+1+r.
+//left and right are scratch space of order values each.
+template <typename Scalar>
+inline void BSplineBasis(const Scalar *knots, int span, Scalar u, int order, Scalar *N, Scalar *left, Scalar *right){
+	N[0] = 1;
+	for(int j = 1; j < order; j++){
+		left[j] = u - knots[span+1-j];
+		right[j] = knots[span+j] - u;
+		Scalar saved = 0;
+		for(int r = 0; r < j; r++){
+			Scalar temp = N[r]/(right[r+1] + left[j-r]);
+			N[r] = saved + right[r+1]*temp;
+			saved = left[j-r]*temp;
+		}
+		N[j] = saved;
+	}
+}
+
+//Span holding u for count control points, clamped to the valid parameter range
+//[knots[order-1], knots[count]] so the end of the range evaluates the last span.
+//hint is a span to try first, sampling in increasing u usually stays put or moves by one.
+template <typename Scalar>
+inline int BSplineSpan(const Scalar *knots, int count, int order, Scalar u, int hint){
+	int first = order-1, last = count-1;
+	if(hint >= first && hint <= last && knots[hint] <= u && (u < knots[hint+1] || hint == last))
+		return hint;
+	if(hint+1 >= first && hint+1 <= last && knots[hint+1] <= u && (u < knots[hint+2] || hint+1 == last))
+		return hint+1;
+	if(u >= knots[last+1]) return last;
+	if(u <= knots[first]) return first;
+	//last span whose start is <= u
+	return (int)(std::upper_bound(knots+first, knots+last+1, u) - knots) - 1;
+}
+
+//B-spline of a fixed order, the basis lives in fixed size arrays and the
+//loops above have constant trip counts once inlined so they unroll.
+//controls and knots (count+Order values) are borrowed, not copied.
+template <int Order, int Dim, typename Scalar>
+class BSpline{
+public:
+	typedef typename SplinePoint<Dim, Scalar>::type Point;
+
+	BSpline(const Point *controls, int count, const Scalar *knots):controls(controls), count(count), knots(knots){}
+
+	Point evaluate(Scalar u) const{
+		int hint = Order-1;
+		return evaluate(u, &hint);
+	}
+
+	//samples count points at first, first+step, ... into out
+	void sample(Scalar first, Scalar step, int samples, Point *out) const{
+		int hint = Order-1;
+		for(int i = 0; i < samples; i++)
+			out[i] = evaluate(first + step*(Scalar)i, &hint);
+	}
+
+private:
+	const Point *controls;
+	int count;
+	const Scalar *knots;
+
+	Point evaluate(Scalar u, int *hint) const{
+		Scalar N[Order], left[Order], right[Order];
+		int span = BSplineSpan(knots, count, Order, u, *hint);
+		*hint = span;
+		BSplineBasis(knots, span, u, Order, N, left, right);
+
+		Point point(0);
+		int base = span-Order+1;
+		for(int r = 0; r < Order; r++)
+			point += controls[base+r]*N[r];
+		return point;
+	}
+};
+
+//Picks the specialized evaluator for the common orders once per curve,
+//anything higher goes through the same basis with runtime sized arrays.
+template <int Dim, typename Scalar>
+void SampleBSpline(int order, const typename SplinePoint<Dim, Scalar>::type *controls, int count, const Scalar *knots,
+	Scalar first, Scalar step, int samples, typename SplinePoint<Dim, Scalar>::type *out){
+	typedef typename SplinePoint<Dim, Scalar>::type Point;
+	if(count < order || samples <= 0) return;
+
+	switch(order){
+	case 1: BSpline<1, Dim, Scalar>(controls, count, knots).sample(first, step, samples, out); return;
+	case 2: BSpline<2, Dim, Scalar>(controls, count, knots).sample(first, step, samples, out); return;
+	case 3: BSpline<3, Dim, Scalar>(controls, count, knots).sample(first, step, samples, out); return;
+	case 4: BSpline<4, Dim, Scalar>(controls, count, knots).sample(first, step, samples, out); return;
+	}
+
+	std::vector<Scalar> N(order), left(order), right(order);
+	int span = order-1;
+	for(int i = 0; i < samples; i++){
+		Scalar u = first + step*(Scalar)i;
+		span = BSplineSpan(knots, count, order, u, span);
+		BSplineBasis(knots, span, u, order, &N[0], &left[0], &right[0]);
+
+		Point point(0);
+		int base = span-order+1;
+		for(int r = 0; r < order; r++)
+			point += controls[base+r]*N[r];
+		out[i] = point;
+	}
+}
@@ -0,0 +1,210 @@
+#include "InputRecorder.h"
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <iostream>
+
+using namespace std;
+
+static const char INPUT_MAGIC[4] = {'I', 'N', 'P', 'T'};
+static const uint32_t INPUT_VERSION = 1;
+static_assert(sizeof(InputEvent) == 20, "InputEvent is written as is");
+
+InputRecorder::InputRecorder(GLFWkeyfun keyCallback, GLFWscrollfun scrollCallback):
+	window(0), keyCallback(keyCallback), scrollCallback(scrollCallback), recordFile(0),
+	replayFile(false), fast(false), done(false), next(0), frame(0),
+	keys(GLFW_KEY_LAST+1, GLFW_RELEASE), cursorX(0), cursorY(0)
+{
+	memset(buttons, GLFW_RELEASE, sizeof(buttons));
+	start = chrono::steady_clock::now();
+}
+
+InputRecorder::~InputRecorder(){
+	if(recordFile){
+		InputEvent end;
+		memset(&end, 0, sizeof(end));
+		end.type = INPUT_END;
+		log(end);
+		recordFile->close();
+		delete recordFile;
+	}
+}
+
+bool InputRecorder::record(const char *path){
+	recordFile = new BufferedWriter(path, 1 << 16);
+	if(!recordFile->ok()){
+		delete recordFile;
+		recordFile = 0;
+		return false;
+	}
+	recordFile->write(INPUT_MAGIC, 4);
+	recordFile->write(&INPUT_VERSION, 4);
+	return true;
+}
+
+bool InputRecorder::replay(const char *path, bool fast){
+	FILE *file = fopen(path, "rb");
+	if(!file) return false;
+	char magic[4];
+	uint32_t version = 0;
+	bool ok = fread(magic, 4, 1, file) == 1 && fread(&version, 4, 1, file) == 1 &&
+		memcmp(magic, INPUT_MAGIC, 4) == 0 && version == INPUT_VERSION;
+	InputEvent event;
+	while(ok && fread(&event, sizeof(event), 1, file) == 1)
+		events.push_back(event);
+	fclose(file);
+	if(!ok || events.empty()) return false;
+
+	replayFile = true;
+	this->fast = fast;
+	return true;
+}
+
+void InputRecorder::attach(GLFWwindow *window){
+	this->window = window;
+	glfwSetWindowUserPointer(window, this);
+	glfwSetKeyCallback(window, onKey);
+	glfwSetMouseButtonCallback(window, onMouseButton);
+	glfwSetCursorPosCallback(window, onCursor);
+	glfwSetScrollCallback(window, onScroll);
+
+	//the cursor does not start at the origin, keep where it was
+	if(recordFile){
+		double x, y;
+		glfwGetCursorPos(window, &x, &y);
+		onCursor(window, x, y);
+	}
+}
+
+//Events that arrive while frame n is being drawn are seen by frame n+1,
+//so a replayed frame gets everything logged before it started
+void InputRecorder::beginFrame(){
+	frame++;
+	if(!replayFile) return;
+
+	while(next < events.size() && events[next].frame < frame){
+		const InputEvent &event = events[next];
+		if(!fast)
+			this_thread::sleep_until(start + chrono::microseconds(event.time));
+		if(event.type == INPUT_END)
+			finish();
+		apply(event);
+		next++;
+	}
+	//a recording cut short by a crash or kill has no INPUT_END
+	if(next == events.size() && !done)
+		finish();
+}
+
+void InputRecorder::finish(){
+	done = true;
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	cout << "Replayed " << frame-1 << " frames in " << seconds << "s (" << (frame-1)/seconds << " fps)" << endl;
+	if(window) glfwSetWindowShouldClose(window, GL_TRUE);
+}
+
+void InputRecorder::log(InputEvent event){
+	event.frame = frame;
+	event.time = (uint32_t)chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+	recordFile->write(&event, sizeof(event));
+	track(event);
+}
+
+//Device state after an event, polled through key(), mouseButton() and cursorPos()
+void InputRecorder::track(const InputEvent &event){
+	if(event.type == INPUT_KEY && event.key.code >= 0 && event.key.code <= GLFW_KEY_LAST){
+		keys[event.key.code] = event.action == GLFW_RELEASE ? GLFW_RELEASE : GLFW_PRESS;
+	}else if(event.type == INPUT_MOUSE_BUTTON && event.key.code >= 0 && event.key.code <= GLFW_MOUSE_BUTTON_LAST){
+		buttons[event.key.code] = event.action;
+	}else if(event.type == INPUT_CURSOR){
+		cursorX = event.position.x;
+		cursorY = event.position.y;
+	}
+}
+
+void InputRecorder::apply(const InputEvent &event){
+	track(event);
+	if(event.type == INPUT_KEY && keyCallback)
+		keyCallback(window, event.key.code, event.key.scancode, event.action, event.mods);
+	else if(event.type == INPUT_SCROLL && scrollCallback)
+		scrollCallback(window, event.position.x, event.position.y);
+}
+
+//While recording the app also sees the logged values rather than the devices,
+//so a replay gets exactly the same input down to the rounding of the cursor
+int InputRecorder::key(int key) const{
+	if(!tracking()) return glfwGetKey(window, key);
+	return (key >= 0 && key <= GLFW_KEY_LAST) ? keys[key] : GLFW_RELEASE;
+}
+
+int InputRecorder::mouseButton(int button) const{
+	if(!tracking()) return glfwGetMouseButton(window, button);
+	return (button >= 0 && button <= GLFW_MOUSE_BUTTON_LAST) ? buttons[button] : GLFW_RELEASE;
+}
+
+void InputRecorder::cursorPos(double *x, double *y) const{
+	if(!tracking()){
+		glfwGetCursorPos(window, x, y);
+		return;
+	}
+	*x = cursorX;
+	*y = cursorY;
+}
+
+InputRecorder *InputRecorder::from(GLFWwindow *window){
+	return (InputRecorder*)glfwGetWindowUserPointer(window);
+}
+
+//Real devices are ignored while replaying
+void InputRecorder::onKey(GLFWwindow *window, int key, int scancode, int action, int mods){
+	InputRecorder *input = from(window);
+	if(input->replayFile) return;
+	if(input->recordFile){
+		InputEvent event;
+		memset(&event, 0, sizeof(event));
+		event.type = INPUT_KEY;
+		event.action = action;
+		event.mods = mods;
+		event.key.code = key;
+		event.key.scancode = scancode;
+		input->log(event);
+	}
+	if(input->keyCallback) input->keyCallback(window, key, scancode, action, mods);
+}
+
+void InputRecorder::onMouseButton(GLFWwindow *window, int button, int action, int mods){
+	InputRecorder *input = from(window);
+	if(input->replayFile || !input->recordFile) return;
+	InputEvent event;
+	memset(&event, 0, sizeof(event));
+	event.type = INPUT_MOUSE_BUTTON;
+	event.action = action;
+	event.mods = mods;
+	event.key.code = button;
+	input->log(event);
+}
+
+void InputRecorder::onCursor(GLFWwindow *window, double x, double y){
+	InputRecorder *input = from(window);
+	if(input->replayFile || !input->recordFile) return;
+	InputEvent event;
+	memset(&event, 0, sizeof(event));
+	event.type = INPUT_CURSOR;
+	event.position.x = (float)x;
+	event.position.y = (float)y;
+	input->log(event);
+}
+
+void InputRecorder::onScroll(GLFWwindow *window, double x, double y){
+	InputRecorder *input = from(window);
+	if(input->replayFile) return;
+	if(input->recordFile){
+		InputEvent event;
+		memset(&event, 0, sizeof(event));
+		event.type = INPUT_SCROLL;
+		event.position.x = (float)x;
+		event.position.y = (float)y;
+		input->log(event);
+	}
+	if(input->scrollCallback) input->scrollCallback(window, x, y);
+}
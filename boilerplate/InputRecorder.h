@@ -0,0 +1,80 @@
+#pragma once
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+#include <vector>
+#include <stdint.h>
+#include <chrono>
+#include "MeshExport.h"
+
+//One GLFW input event, tagged with the frame it was handed to the app in
+struct InputEvent{
+	uint32_t frame;
+	uint32_t time;		//Microseconds since recording started
+	uint8_t type;		//InputEventType
+	uint8_t action;		//GLFW_PRESS, GLFW_RELEASE or GLFW_REPEAT
+	uint8_t mods;
+	uint8_t unused;
+	union{
+		struct{ int32_t code, scancode; } key;	//Key or mouse button
+		struct{ float x, y; } position;			//Cursor position or scroll offset
+	};
+};
+
+enum InputEventType{
+	INPUT_KEY,
+	INPUT_MOUSE_BUTTON,
+	INPUT_CURSOR,
+	INPUT_SCROLL,
+	INPUT_END			//Last event, frame is the number of frames recorded
+};
+
+//Sits between GLFW and the app. Live it passes input through, optionally
+//logging every event to a file; replaying it ignores the real devices and
+//feeds the logged events back on the same frames they first arrived on.
+//The main loop polls keys, buttons and the cursor through here.
+class InputRecorder{
+public:
+	InputRecorder(GLFWkeyfun keyCallback, GLFWscrollfun scrollCallback);
+	~InputRecorder();
+
+	bool record(const char *path);
+	bool replay(const char *path, bool fast);	//fast skips waiting for the recorded times
+	void attach(GLFWwindow *window);			//Takes over the window's input callbacks
+
+	void beginFrame();			//Call once at the top of every frame
+	bool replaying() const { return replayFile; }
+	bool finished() const { return done; }
+
+	int key(int key) const;
+	int mouseButton(int button) const;
+	void cursorPos(double *x, double *y) const;
+
+private:
+	GLFWwindow *window;
+	GLFWkeyfun keyCallback;
+	GLFWscrollfun scrollCallback;
+
+	BufferedWriter *recordFile;
+	bool replayFile, fast, done;
+	std::vector<InputEvent> events;
+	unsigned int next;
+	uint32_t frame;
+	std::chrono::steady_clock::time_point start;
+
+	//Replayed device state
+	std::vector<unsigned char> keys;
+	unsigned char buttons[GLFW_MOUSE_BUTTON_LAST+1];
+	double cursorX, cursorY;
+
+	bool tracking() const { return recordFile || replayFile || !window; }	//No window, no devices
+	void log(InputEvent event);
+	void track(const InputEvent &event);
+	void apply(const InputEvent &event);
+	void finish();		//End of the replay
+
+	static InputRecorder *from(GLFWwindow *window);
+	static void onKey(GLFWwindow *window, int key, int scancode, int action, int mods);
+	static void onMouseButton(GLFWwindow *window, int button, int action, int mods);
+	static void onCursor(GLFWwindow *window, double x, double y);
+	static void onScroll(GLFWwindow *window, double x, double y);
+};
@@ -0,0 +1,215 @@
+#include "MeshExport.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <math.h>
+
+using namespace std;
+using namespace glm;
+
+BufferedWriter::BufferedWriter(const char *path, size_t capacity):failed(false), buffer(capacity), used(0){
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+}
+
+BufferedWriter::~BufferedWriter(){
+	close();
+}
+
+void BufferedWriter::writeAll(const char *data, size_t size){
+	size_t done = 0;
+	while(fd >= 0 && !failed && done < size){
+		ssize_t n = ::write(fd, data + done, size - done);
+		if(n < 0) failed = true;
+		else done += n;
+	}
+}
+
+void BufferedWriter::flush(){
+	writeAll(buffer.data(), used);
+	used = 0;
+}
+
+void BufferedWriter::write(const void *data, size_t size){
+	if(used + size > buffer.size()){
+		flush();
+		//too big to be worth copying, hand it to the kernel as is
+		if(size > buffer.size()){
+			writeAll((const char*)data, size);
+			return;
+		}
+	}
+	memcpy(&buffer[used], data, size);
+	used += size;
+}
+
+void BufferedWriter::text(const char *string){
+	write(string, strlen(string));
+}
+
+//Writes digits of value backwards ending at end, returns the first digit
+static char *formatUnsigned(char *end, uint64_t value, int minDigits){
+	char *p = end;
+	do{
+		*--p = '0' + (char)(value % 10);
+		value /= 10;
+		minDigits--;
+	}while(value || minDigits > 0);
+	return p;
+}
+
+void BufferedWriter::number(unsigned int value){
+	char digits[16];
+	char *first = formatUnsigned(digits + sizeof(digits), value, 1);
+	write(first, digits + sizeof(digits) - first);
+}
+
+void BufferedWriter::number(float value){
+	//fixed point integer formatting covers everything a model has, printf the rest
+	if(!(fabsf(value) < 1e12f)){
+		char text[32];
+		int length = snprintf(text, sizeof(text), "%g", value);
+		write(text, length);
+		return;
+	}
+	int64_t scaled = llround((double)value*1e6);
+	bool negative = scaled < 0;
+	uint64_t magnitude = negative ? -scaled : scaled;
+	uint64_t whole = magnitude/1000000, fraction = magnitude%1000000;
+
+	char digits[32];
+	char *end = digits + sizeof(digits);
+	char *p = end;
+	if(fraction){
+		int places = 6;
+		while(fraction % 10 == 0){
+			fraction /= 10;
+			places--;
+		}
+		p = formatUnsigned(p, fraction, places);
+		*--p = '.';
+	}
+	p = formatUnsigned(p, whole, 1);
+	if(negative) *--p = '-';
+	write(p, end - p);
+}
+
+bool BufferedWriter::close(){
+	if(fd < 0) return false;
+	flush();
+	bool closed = ::close(fd) == 0;
+	fd = -1;
+	return closed && !failed;
+}
+
+//Both triangles of cell (i, j) as grid indices
+static void cellTriangles(const SurfaceGrid &grid, unsigned int i, unsigned int j, uint32_t out[6]){
+	uint32_t a = i*grid.columns + j;
+	uint32_t b = a + grid.columns;
+	out[0] = a;		out[1] = a + 1;	out[2] = b;
+	out[3] = b;		out[4] = a + 1;	out[5] = b + 1;
+}
+
+//STL and PLY are written as host memory, which is the little endian they ask for on x86 and ARM
+static void exportSTL(const SurfaceGrid &grid, BufferedWriter &out){
+	char header[80];
+	memset(header, 0, sizeof(header));
+	strncpy(header, "CPSC589 sweep surface", sizeof(header));
+	out.write(header, sizeof(header));
+	uint32_t count = grid.triangles();
+	out.write(&count, 4);
+
+	//normal, three corners and a zero attribute count, 50 bytes each
+	for(unsigned int i = 0; i + 1 < grid.rows; i++){
+		for(unsigned int j = 0; j + 1 < grid.columns; j++){
+			uint32_t index[6];
+			cellTriangles(grid, i, j, index);
+			for(int t = 0; t < 6; t += 3){
+				vec3 facet[4];
+				facet[1] = grid.points[index[t]];
+				facet[2] = grid.points[index[t+1]];
+				facet[3] = grid.points[index[t+2]];
+				vec3 n = cross(facet[2] - facet[1], facet[3] - facet[1]);
+				float l = length(n);
+				facet[0] = l > 0.f ? n/l : vec3(0.f);
+				char record[50];
+				memcpy(record, facet, 48);
+				record[48] = record[49] = 0;
+				out.write(record, 50);
+			}
+		}
+	}
+}
+
+static void exportPLY(const SurfaceGrid &grid, BufferedWriter &out){
+	out.text("ply\nformat binary_little_endian 1.0\nelement vertex ");
+	out.number((unsigned int)grid.points.size());
+	out.text("\nproperty float x\nproperty float y\nproperty float z\nelement face ");
+	out.number(grid.triangles());
+	out.text("\nproperty list uchar uint vertex_indices\nend_header\n");
+
+	out.write(grid.points.data(), grid.points.size()*sizeof(vec3));
+	for(unsigned int i = 0; i + 1 < grid.rows; i++){
+		for(unsigned int j = 0; j + 1 < grid.columns; j++){
+			uint32_t index[6];
+			cellTriangles(grid, i, j, index);
+			for(int t = 0; t < 6; t += 3){
+				char record[13];
+				record[0] = 3;
+				memcpy(record + 1, index + t, 12);
+				out.write(record, 13);
+			}
+		}
+	}
+}
+
+static void exportOBJ(const SurfaceGrid &grid, BufferedWriter &out){
+	out.text("# CPSC589 sweep surface\n");
+	for(unsigned int i = 0; i < grid.points.size(); i++){
+		const vec3 &p = grid.points[i];
+		out.text("v ");
+		out.number(p.x);
+		out.text(" ");
+		out.number(p.y);
+		out.text(" ");
+		out.number(p.z);
+		out.text("\n");
+	}
+	for(unsigned int i = 0; i + 1 < grid.rows; i++){
+		for(unsigned int j = 0; j + 1 < grid.columns; j++){
+			uint32_t index[6];
+			cellTriangles(grid, i, j, index);
+			for(int t = 0; t < 6; t += 3){
+				//OBJ counts from 1
+				out.text("f ");
+				out.number(index[t] + 1);
+				out.text(" ");
+				out.number(index[t+1] + 1);
+				out.text(" ");
+				out.number(index[t+2] + 1);
+				out.text("\n");
+			}
+		}
+	}
+}
+
+bool ExportSurface(const SurfaceGrid &grid, ExportFormat format, const char *path){
+	BufferedWriter out(path);
+	if(!out.ok()) return false;
+	if(format == EXPORT_STL) exportSTL(grid, out);
+	else if(format == EXPORT_PLY) exportPLY(grid, out);
+	else exportOBJ(grid, out);
+	return out.close();
+}
+
+bool ExportFormatFromPath(const char *path, ExportFormat *format){
+	const char *dot = strrchr(path, '.');
+	if(!dot) return false;
+	if(strcasecmp(dot, ".stl") == 0) *format = EXPORT_STL;
+	else if(strcasecmp(dot, ".ply") == 0) *format = EXPORT_PLY;
+	else if(strcasecmp(dot, ".obj") == 0) *format = EXPORT_OBJ;
+	else return false;
+	return true;
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <stddef.h>
+
+//The generated surface as rows x columns points, row major.
+//Each grid cell becomes two triangles with the same winding as the model mesh.
+struct SurfaceGrid{
+	std::vector<glm::vec3> points;
+	unsigned int rows, columns;
+
+	SurfaceGrid():rows(0), columns(0){}
+	unsigned int triangles() const { return (rows > 1 && columns > 1) ? 2*(rows-1)*(columns-1) : 0; }
+};
+
+enum ExportFormat{
+	EXPORT_STL,	//Binary STL, unindexed triangles with facet normals
+	EXPORT_PLY,	//Binary little endian PLY, indexed
+	EXPORT_OBJ	//Wavefront OBJ text, indexed
+};
+
+//Writes the surface straight from the grid, no GL involved so it works headless
+bool ExportSurface(const SurfaceGrid &grid, ExportFormat format, const char *path);
+
+//Picks the format from a .stl, .ply or .obj extension
+bool ExportFormatFromPath(const char *path, ExportFormat *format);
+
+//Large output buffer over a file descriptor, flushed with write(2) when full
+class BufferedWriter{
+public:
+	BufferedWriter(const char *path, size_t capacity = 1 << 20);
+	~BufferedWriter();
+
+	bool ok() const { return fd >= 0 && !failed; }
+	void write(const void *data, size_t size);
+	void text(const char *string);
+	void number(float value);	//Decimal text, at most 6 places after the point
+	void number(unsigned int value);
+	bool close();
+
+private:
+	int fd;
+	bool failed;
+	std::vector<char> buffer;
+	size_t used;
+
+	void writeAll(const char *data, size_t size);
+	void flush();
+};
@@ -0,0 +1,151 @@
+#include "Offscreen.h"
+#include <iostream>
+#include <stdio.h>
+
+#ifdef __linux__
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#endif
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb/stb_image_write.h>
+
+using namespace std;
+
+OffscreenContext::OffscreenContext():display(0), context(0){}
+
+OffscreenContext::~OffscreenContext(){
+#ifdef __linux__
+	if(context){
+		eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+		eglDestroyContext(display, context);
+	}
+	if(display) eglTerminate(display);
+#endif
+}
+
+bool OffscreenContext::create(){
+#ifdef __linux__
+	//Mesa's surfaceless platform needs no X, Wayland or GPU device
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+		(PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if(getPlatformDisplay)
+		display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+	if(!display)
+		display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+	if(!display || !eglInitialize(display, 0, 0)){
+		cout << "EGL display unavailable" << endl;
+		display = 0;
+		return false;
+	}
+	if(!eglBindAPI(EGL_OPENGL_API)){
+		cout << "EGL has no desktop OpenGL" << endl;
+		return false;
+	}
+
+	const EGLint attributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, 4,
+		EGL_CONTEXT_MINOR_VERSION, 1,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_NONE
+	};
+	context = eglCreateContext(display, EGL_NO_CONFIG_KHR, EGL_NO_CONTEXT, attributes);
+	if(context == EGL_NO_CONTEXT){
+		cout << "Failed to create an OpenGL 4.1 core EGL context" << endl;
+		context = 0;
+		return false;
+	}
+	return eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context);
+#else
+	cout << "Offscreen rendering needs EGL, only available on Linux" << endl;
+	return false;
+#endif
+}
+
+GLADloadproc OffscreenContext::loader() const{
+#ifdef __linux__
+	return (GLADloadproc)eglGetProcAddress;
+#else
+	return 0;
+#endif
+}
+
+bool InitializeOffscreenTarget(OffscreenTarget *target, int width, int height){
+	target->width = width;
+	target->height = height;
+
+	glGenRenderbuffers(1, &target->colour);
+	glBindRenderbuffer(GL_RENDERBUFFER, target->colour);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &target->depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, target->depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &target->framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, target->framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, target->colour);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, target->depth);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+
+	//stays bound, it is the screen from here on. A window starts with its
+	//depth cleared and the 2D modes never clear it, so do the same here
+	glViewport(0, 0, width, height);
+	glClearDepth(1.0);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	if(!complete)
+		cout << "Offscreen framebuffer is incomplete" << endl;
+	return complete;
+}
+
+void DestroyOffscreenTarget(OffscreenTarget *target){
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &target->framebuffer);
+	glDeleteRenderbuffers(1, &target->colour);
+	glDeleteRenderbuffers(1, &target->depth);
+}
+
+FrameCapture::FrameCapture(int width, int height, const string &prefix):
+	width(width), height(height), prefix(prefix), queued(0), written(0)
+{
+	glGenBuffers(BUFFERS, buffers);
+	for(int i = 0; i < BUFFERS; i++){
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[i]);
+		glBufferData(GL_PIXEL_PACK_BUFFER, width*height*4, 0, GL_STREAM_READ);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+FrameCapture::~FrameCapture(){
+	glDeleteBuffers(BUFFERS, buffers);
+}
+
+void FrameCapture::capture(GLuint framebuffer){
+	//every buffer is in use, the oldest has had BUFFERS-1 frames to finish
+	if(queued - written == BUFFERS) write();
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[queued % BUFFERS]);
+	glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	queued++;
+}
+
+void FrameCapture::finish(){
+	while(written < queued) write();
+}
+
+void FrameCapture::write(){
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, buffers[written % BUFFERS]);
+	const unsigned char *pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, width*height*4, GL_MAP_READ_BIT);
+	if(pixels){
+		char name[16];
+		snprintf(name, sizeof(name), "%05u.png", written);
+		//GL rows run bottom up, a negative stride flips them
+		if(!stbi_write_png((prefix + name).c_str(), width, height, 4, pixels + (height-1)*width*4, -width*4))
+			cout << "Failed to write " << prefix << name << endl;
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	written++;
+}
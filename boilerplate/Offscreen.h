@@ -0,0 +1,57 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+
+//OpenGL 4.1 core context without a window or display, for running on build
+//machines. Uses a surfaceless EGL display on Linux; elsewhere create() fails.
+class OffscreenContext{
+public:
+	OffscreenContext();
+	~OffscreenContext();
+
+	bool create();
+	GLADloadproc loader() const;
+
+private:
+	void *display;
+	void *context;
+
+	OffscreenContext(const OffscreenContext &);
+	OffscreenContext &operator=(const OffscreenContext &);
+};
+
+//Colour and depth renderbuffers standing in for the window's framebuffer
+struct OffscreenTarget{
+	GLuint framebuffer, colour, depth;
+	int width, height;
+
+	OffscreenTarget():framebuffer(0), colour(0), depth(0), width(0), height(0){}
+};
+
+bool InitializeOffscreenTarget(OffscreenTarget *target, int width, int height);
+void DestroyOffscreenTarget(OffscreenTarget *target);
+
+//Reads frames back through a ring of pixel buffers so glReadPixels does not
+//stall: a frame is written out once the GPU is a few frames further along.
+//Frames go to prefix00000.png, prefix00001.png, ...
+class FrameCapture{
+public:
+	static const int BUFFERS = 3;
+
+	FrameCapture(int width, int height, const std::string &prefix);
+	~FrameCapture();
+
+	void capture(GLuint framebuffer);	//Queues the frame just drawn
+	void finish();						//Writes everything still queued
+
+private:
+	int width, height;
+	std::string prefix;
+	GLuint buffers[BUFFERS];
+	unsigned int queued, written;
+
+	void write();
+
+	FrameCapture(const FrameCapture &);
+	FrameCapture &operator=(const FrameCapture &);
+};
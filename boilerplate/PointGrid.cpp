@@ -0,0 +1,94 @@
+#include "PointGrid.h"
+#include <algorithm>
+
+using namespace std;
+using namespace glm;
+
+PointGrid::PointGrid(vec2 lo, vec2 hi, int resolution):lo(lo), resolution(resolution){
+	cellSize = (hi - lo)/(float)resolution;
+	cells.resize(resolution*resolution);
+}
+
+//points outside the area are kept in the border cells
+ivec2 PointGrid::cellOf(vec2 position) const{
+	ivec2 cell = ivec2(floor((position - lo)/cellSize));
+	return glm::clamp(cell, ivec2(0), ivec2(resolution-1));
+}
+
+vector<PointGrid::Entry> &PointGrid::cellAt(vec2 position){
+	ivec2 cell = cellOf(position);
+	return cells[cell.y*resolution + cell.x];
+}
+
+void PointGrid::insert(PointRef ref, vec2 position){
+	Entry entry;
+	entry.ref = ref;
+	entry.position = position;
+	cellAt(position).push_back(entry);
+}
+
+void PointGrid::remove(PointRef ref, vec2 position){
+	vector<Entry> &cell = cellAt(position);
+	for(unsigned int i = 0; i < cell.size(); i++){
+		if(cell[i].ref == ref){
+			cell[i] = cell.back();
+			cell.pop_back();
+			return;
+		}
+	}
+}
+
+void PointGrid::move(PointRef ref, vec2 from, vec2 to){
+	ivec2 a = cellOf(from), b = cellOf(to);
+	if(a != b){
+		remove(ref, from);
+		insert(ref, to);
+		return;
+	}
+	//same cell, just update the stored position
+	vector<Entry> &cell = cells[a.y*resolution + a.x];
+	for(unsigned int i = 0; i < cell.size(); i++){
+		if(cell[i].ref == ref){
+			cell[i].position = to;
+			return;
+		}
+	}
+}
+
+void PointGrid::removeCurve(int curve){
+	for(unsigned int c = 0; c < cells.size(); c++){
+		vector<Entry> &cell = cells[c];
+		for(unsigned int i = 0; i < cell.size(); ){
+			if(cell[i].ref.curve == curve){
+				cell[i] = cell.back();
+				cell.pop_back();
+			}else{
+				i++;
+			}
+		}
+	}
+}
+
+bool PointGrid::nearest(vec2 position, float radius, unsigned int curveMask, PointRef *found) const{
+	ivec2 first = cellOf(position - vec2(radius));
+	ivec2 last = cellOf(position + vec2(radius));
+	float best = radius*radius;
+	bool hit = false;
+
+	for(int y = first.y; y <= last.y; y++){
+		for(int x = first.x; x <= last.x; x++){
+			const vector<Entry> &cell = cells[y*resolution + x];
+			for(unsigned int i = 0; i < cell.size(); i++){
+				if(!(curveMask & (1u << cell[i].ref.curve))) continue;
+				vec2 offset = cell[i].position - position;
+				float d = dot(offset, offset);
+				if(d <= best){
+					best = d;
+					*found = cell[i].ref;
+					hit = true;
+				}
+			}
+		}
+	}
+	return hit;
+}
@@ -0,0 +1,42 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+
+//A control point, by curve number and index into that curve
+struct PointRef{
+	int curve;
+	unsigned int index;
+
+	PointRef():curve(-1), index(0){}
+	PointRef(int curve, unsigned int index):curve(curve), index(index){}
+	bool operator==(const PointRef &other) const { return curve == other.curve && index == other.index; }
+};
+
+//Uniform grid over the editing area for picking control points.
+//Inserting, removing and moving a point only touches its cell(s), and a
+//nearest query only looks at the cells within the search radius.
+class PointGrid{
+public:
+	PointGrid(glm::vec2 lo, glm::vec2 hi, int resolution);
+
+	void insert(PointRef ref, glm::vec2 position);
+	void remove(PointRef ref, glm::vec2 position);
+	void move(PointRef ref, glm::vec2 from, glm::vec2 to);
+	void removeCurve(int curve);	//Visits every cell, only for clearing a whole curve
+
+	//Closest point within radius whose curve bit is set in curveMask
+	bool nearest(glm::vec2 position, float radius, unsigned int curveMask, PointRef *found) const;
+
+private:
+	struct Entry{
+		PointRef ref;
+		glm::vec2 position;
+	};
+
+	glm::vec2 lo, cellSize;
+	int resolution;
+	std::vector< std::vector<Entry> > cells;
+
+	glm::ivec2 cellOf(glm::vec2 position) const;
+	std::vector<Entry> &cellAt(glm::vec2 position);
+};
@@ -0,0 +1,119 @@
+#include "ProgramCache.h"
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+using namespace std;
+
+//Header written in front of every cached binary
+struct ProgramCacheHeader{
+	char magic[4];
+	GLenum format;
+	uint64_t key;
+	uint32_t length;
+};
+
+const char CACHE_MAGIC[4] = {'P', 'B', 'I', 'N'};
+
+//64-bit FNV-1a, continued from the given hash
+static uint64_t fnv1a(const string &data, uint64_t hash){
+	for(size_t i = 0; i < data.size(); i++){
+		hash ^= (unsigned char)data[i];
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+static string glString(GLenum name){
+	const GLubyte *value = glGetString(name);
+	return value ? string(reinterpret_cast<const char *>(value)) : string();
+}
+
+ProgramCache::ProgramCache(const string &directory, GLADloadproc loader):directory(directory), enabled(false){
+	driver = glString(GL_VENDOR) + "|" + glString(GL_RENDERER) + "|" + glString(GL_VERSION);
+
+	getProgramBinary = (PFNGLGETPROGRAMBINARYPROC)loader("glGetProgramBinary");
+	programBinary = (PFNGLPROGRAMBINARYPROC)loader("glProgramBinary");
+	programParameteri = (PFNGLPROGRAMPARAMETERIPROC)loader("glProgramParameteri");
+
+	GLint formats = 0;
+	if(getProgramBinary && programBinary && programParameteri)
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+	enabled = formats > 0;
+	if(enabled)
+		mkdir(directory.c_str(), 0755);
+}
+
+uint64_t ProgramCache::key(const vector<string> &sources) const{
+	uint64_t hash = fnv1a(driver, 14695981039346656037ULL);
+	for(size_t i = 0; i < sources.size(); i++){
+		//separator so moving text between stages changes the key
+		hash = fnv1a(sources[i], fnv1a(string(1, '\0'), hash));
+	}
+	return hash;
+}
+
+void ProgramCache::retrievable(GLuint program) const{
+	if(enabled)
+		programParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+}
+
+string ProgramCache::path(uint64_t key) const{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+	return directory + "/" + name;
+}
+
+GLuint ProgramCache::load(uint64_t key) const{
+	if(!enabled) return 0;
+
+	ifstream input(path(key).c_str(), ios::binary);
+	if(!input) return 0;
+
+	ProgramCacheHeader header;
+	if(!input.read(reinterpret_cast<char *>(&header), sizeof(header))) return 0;
+	if(string(header.magic, 4) != string(CACHE_MAGIC, 4) || header.key != key) return 0;
+
+	vector<char> binary(header.length);
+	if(!input.read(binary.data(), binary.size())) return 0;
+
+	GLuint program = glCreateProgram();
+	programBinary(program, header.format, binary.data(), binary.size());
+
+	//drivers may reject binaries from an older build even when the strings match
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if(status == GL_FALSE){
+		glDeleteProgram(program);
+		return 0;
+	}
+	return program;
+}
+
+void ProgramCache::store(uint64_t key, GLuint program) const{
+	if(!enabled || program == 0) return;
+
+	GLint status = GL_FALSE, length = 0;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if(status == GL_FALSE || length <= 0) return;
+
+	vector<char> binary(length);
+	ProgramCacheHeader header = {};	//zeroes the tail padding too, the header is written raw
+	copy(CACHE_MAGIC, CACHE_MAGIC+4, header.magic);
+	header.key = key;
+	GLsizei written = 0;
+	getProgramBinary(program, length, &written, &header.format, binary.data());
+	header.length = written;
+
+	ofstream output(path(key).c_str(), ios::binary | ios::trunc);
+	if(!output){
+		cout << "Could not write program cache entry " << path(key) << endl;
+		return;
+	}
+	output.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	output.write(binary.data(), written);
+}
@@ -0,0 +1,39 @@
+#pragma once
+#include <glad/glad.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//The bundled glad only covers GL 4.0, program binaries arrived in 4.1
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+typedef void (APIENTRYP PFNGLGETPROGRAMBINARYPROC)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void (APIENTRYP PFNGLPROGRAMBINARYPROC)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void (APIENTRYP PFNGLPROGRAMPARAMETERIPROC)(GLuint program, GLenum pname, GLint value);
+
+//Stores linked program binaries on disk so later launches can skip compiling.
+//Entries are keyed by a hash of the shader sources and the driver strings,
+//so any edit or driver change simply misses and recompiles.
+class ProgramCache{
+public:
+	std::string directory;
+	std::string driver;		//Vendor, renderer and version of the current context
+	bool enabled;			//False when the driver offers no binary formats
+
+	ProgramCache(const std::string &directory, GLADloadproc loader);	//Needs a current GL context
+
+	uint64_t key(const std::vector<std::string> &sources) const;
+	void retrievable(GLuint program) const;		//Call before linking a program that will be stored
+	GLuint load(uint64_t key) const;			//0 on miss or if the driver rejects the binary
+	void store(uint64_t key, GLuint program) const;
+
+private:
+	PFNGLGETPROGRAMBINARYPROC getProgramBinary;
+	PFNGLPROGRAMBINARYPROC programBinary;
+	PFNGLPROGRAMPARAMETERIPROC programParameteri;
+
+	std::string path(uint64_t key) const;
+};
@@ -0,0 +1,128 @@
+#include "ProjectFile.h"
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+
+using namespace std;
+using namespace glm;
+
+//The sections are read as raw arrays of these
+static_assert(sizeof(vec2) == 8 && sizeof(vec3) == 12, "glm vectors must be tightly packed");
+static_assert(sizeof(PackedVertex) == 12, "PackedVertex must be 12 bytes");
+static_assert(sizeof(ProjectHeader) % 8 == 0, "ProjectHeader must keep its sections aligned");
+
+static uint64_t alignUp(uint64_t offset){
+	return (offset + PROJECT_ALIGNMENT - 1) & ~(uint64_t)(PROJECT_ALIGNMENT - 1);
+}
+
+//Places count elements after end, returns the new end
+static uint64_t place(ProjectSection *section, uint64_t end, uint64_t count, size_t elementSize){
+	section->count = count;
+	section->offset = count ? alignUp(end) : 0;
+	return count ? section->offset + count*elementSize : end;
+}
+
+static void writeSection(BufferedWriter &out, uint64_t *written, const ProjectSection &section, const void *data, size_t elementSize){
+	if(!section.count) return;
+	static const char zeros[PROJECT_ALIGNMENT] = {0};
+	out.write(zeros, section.offset - *written);
+	out.write(data, section.count*elementSize);
+	*written = section.offset + section.count*elementSize;
+}
+
+bool SaveProject(const char *path, const ProjectData &data){
+	ProjectHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "SWPJ", 4);
+	header.version = PROJECT_VERSION;
+	header.byteOrder = PROJECT_BYTE_ORDER;
+	header.modelRows = data.modelRows;
+
+	uint64_t end = sizeof(ProjectHeader);
+	for(int c = 0; c < 3; c++)
+		end = place(&header.curves[c], end, data.curves[c]->size(), sizeof(vec2));
+	if(data.surface && data.surface->triangles()){
+		header.surfaceRows = data.surface->rows;
+		header.surfaceColumns = data.surface->columns;
+		end = place(&header.surface, end, data.surface->points.size(), sizeof(vec3));
+	}
+	if(data.mesh && !data.mesh->vertices.empty()){
+		header.meshLayout = data.mesh->layout;
+		memcpy(header.dequantize, &data.mesh->dequantize[0][0], sizeof(header.dequantize));
+		end = place(&header.mesh, end, data.mesh->vertices.size(), sizeof(PackedVertex));
+	}
+
+	BufferedWriter out(path);
+	if(!out.ok()) return false;
+	out.write(&header, sizeof(header));
+	uint64_t written = sizeof(header);
+	for(int c = 0; c < 3; c++)
+		writeSection(out, &written, header.curves[c], data.curves[c]->data(), sizeof(vec2));
+	if(header.surface.count)
+		writeSection(out, &written, header.surface, data.surface->points.data(), sizeof(vec3));
+	if(header.mesh.count)
+		writeSection(out, &written, header.mesh, data.mesh->vertices.data(), sizeof(PackedVertex));
+	return out.close();
+}
+
+ProjectFile::ProjectFile():data(0), size(0){}
+
+ProjectFile::~ProjectFile(){
+	close();
+}
+
+void ProjectFile::close(){
+	if(data) munmap(data, size);
+	data = 0;
+	size = 0;
+}
+
+bool ProjectFile::valid(const ProjectSection &section, size_t elementSize) const{
+	if(!section.count) return true;
+	return section.offset % PROJECT_ALIGNMENT == 0 && section.offset <= size &&
+		section.count <= (size - section.offset)/elementSize;
+}
+
+const void *ProjectFile::section(const ProjectSection &section) const{
+	return section.count ? (const char*)data + section.offset : 0;
+}
+
+bool ProjectFile::open(const char *path){
+	close();
+	int fd = ::open(path, O_RDONLY);
+	if(fd < 0) return false;
+	struct stat info;
+	if(fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(ProjectHeader)){
+		size = info.st_size;
+		data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(data == MAP_FAILED) data = 0;
+	}
+	::close(fd);
+	if(!data) return false;
+
+	const ProjectHeader *h = header();
+	bool ok = memcmp(h->magic, "SWPJ", 4) == 0 && h->version == PROJECT_VERSION &&
+		h->byteOrder == PROJECT_BYTE_ORDER && h->modelRows >= 2 && h->modelRows <= PROJECT_MAX_MODEL_ROWS;
+	for(int c = 0; c < 3 && ok; c++)
+		ok = valid(h->curves[c], sizeof(vec2));
+	ok = ok && valid(h->surface, sizeof(vec3)) && valid(h->mesh, sizeof(PackedVertex)) &&
+		h->surface.count == (uint64_t)h->surfaceRows*h->surfaceColumns && h->meshLayout <= LAYOUT_PACKED_2_10_10_10;
+	if(!ok) close();
+	return ok;
+}
+
+const vec2 *ProjectFile::curve(int c, unsigned int *count) const{
+	*count = header()->curves[c].count;
+	return (const vec2*)section(header()->curves[c]);
+}
+
+const vec3 *ProjectFile::surface() const{
+	return (const vec3*)section(header()->surface);
+}
+
+const PackedVertex *ProjectFile::mesh(unsigned int *count) const{
+	*count = header()->mesh.count;
+	return (const PackedVertex*)section(header()->mesh);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+#include "VertexFormat.h"
+#include "MeshExport.h"
+
+//Project file layout, version 1. Everything is in the byte order of the
+//machine that saved it, which byteOrder records and open() checks. Every
+//section starts on a PROJECT_ALIGNMENT boundary, so a mapped file is used in
+//place: sections are found by offset and read as arrays of glm::vec2,
+//glm::vec3 and PackedVertex.
+const uint32_t PROJECT_VERSION = 1;
+const uint32_t PROJECT_BYTE_ORDER = 0x01020304;
+const size_t PROJECT_ALIGNMENT = 64;
+const uint32_t PROJECT_MAX_MODEL_ROWS = 1 << 16;	//Far beyond anything the editor makes
+
+struct ProjectSection{
+	uint64_t offset;	//From the start of the file, 0 when absent
+	uint64_t count;		//Elements, not bytes
+};
+
+struct ProjectHeader{
+	char magic[4];				//"SWPJ"
+	uint32_t version;
+	uint32_t byteOrder;			//PROJECT_BYTE_ORDER as written by the saving machine
+	uint32_t modelRows;			//Generation parameters
+	uint32_t meshLayout;		//VertexLayout of the cached mesh
+	uint32_t surfaceRows, surfaceColumns;
+	uint32_t reserved;
+	float dequantize[16];		//Column major, for the cached mesh
+	ProjectSection curves[3];	//glm::vec2 control points
+	ProjectSection surface;		//glm::vec3, surfaceRows x surfaceColumns
+	ProjectSection mesh;		//PackedVertex triangle list
+};
+
+//What gets saved, all borrowed. surface and mesh may be null.
+struct ProjectData{
+	const std::vector<glm::vec2> *curves[3];
+	unsigned int modelRows;
+	const SurfaceGrid *surface;
+	const QuantizedMesh *mesh;
+};
+
+bool SaveProject(const char *path, const ProjectData &data);
+
+//A project mapped read only. Pointers stay valid until the file is closed.
+class ProjectFile{
+public:
+	ProjectFile();
+	~ProjectFile();
+
+	bool open(const char *path);	//Maps and validates, false if the file is unusable
+	void close();
+
+	const ProjectHeader *header() const { return (const ProjectHeader*)data; }
+	const glm::vec2 *curve(int c, unsigned int *count) const;
+	const glm::vec3 *surface() const;		//Null when not cached
+	const PackedVertex *mesh(unsigned int *count) const;	//Null when not cached
+
+private:
+	void *data;
+	size_t size;
+
+	bool valid(const ProjectSection &section, size_t elementSize) const;
+	const void *section(const ProjectSection &section) const;
+};
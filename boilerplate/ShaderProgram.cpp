@@ -0,0 +1,41 @@
+#include "ShaderProgram.h"
+#include <vector>
+
+using namespace std;
+
+void ShaderProgram::attach(GLuint program){
+	id = program;
+	uniforms.clear();
+	if(id == 0) return;
+
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	vector<GLchar> name(maxLength > 0 ? maxLength : 1);
+
+	for(GLint i = 0; i < count; i++){
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(id, i, name.size(), &length, &size, &type, name.data());
+		string uniformName(name.data(), length);
+		//arrays are reported as "name[0]", store them under the plain name
+		if(uniformName.size() > 3 && uniformName.compare(uniformName.size()-3, 3, "[0]") == 0)
+			uniformName.erase(uniformName.size()-3);
+		//uniforms inside blocks have no location and are skipped
+		GLint location = glGetUniformLocation(id, uniformName.c_str());
+		if(location != -1)
+			uniforms[uniformName] = location;
+	}
+}
+
+GLint ShaderProgram::uniform(const string &name) const{
+	map<string, GLint>::const_iterator it = uniforms.find(name);
+	return it == uniforms.end() ? -1 : it->second;
+}
+
+void ShaderProgram::bindBlock(const char *name, GLuint bindingPoint) const{
+	GLuint index = glGetUniformBlockIndex(id, name);
+	if(index != GL_INVALID_INDEX)
+		glUniformBlockBinding(id, index, bindingPoint);
+}
@@ -0,0 +1,31 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <map>
+#include <string>
+
+//Wraps a linked program and looks up every active uniform once, at link time,
+//so drawing never has to call glGetUniformLocation
+class ShaderProgram{
+public:
+	GLuint id;
+	std::map<std::string, GLint> uniforms;
+
+	ShaderProgram():id(0){}
+	ShaderProgram(GLuint id):id(0){ attach(id); }
+
+	void attach(GLuint program);	//Takes over a freshly linked program and caches its uniforms
+	GLint uniform(const std::string &name) const;	//-1 if the program has no such uniform
+	void bindBlock(const char *name, GLuint bindingPoint) const;	//No-op if the block is absent
+};
+
+//Per-frame data shared by every program through one std140 uniform block.
+//Layout must match the FrameData block in the shaders.
+struct FrameUniforms{
+	glm::mat4 modelViewProjection;
+	glm::vec4 cameraPos;
+	glm::vec4 light;
+	glm::vec4 viewport;		//Framebuffer width and height in xy
+};
+
+const GLuint FRAME_UNIFORM_BINDING = 0;
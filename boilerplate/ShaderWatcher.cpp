@@ -0,0 +1,56 @@
+#include "ShaderWatcher.h"
+#include <algorithm>
+#include <iostream>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+using namespace std;
+
+ShaderWatcher::ShaderWatcher(const string &directory):directory(directory), fd(-1), watch(-1){
+#ifdef __linux__
+	fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if(fd < 0){
+		cout << "Shader hot reload disabled, inotify unavailable" << endl;
+		return;
+	}
+	//editors either rewrite in place or write a temporary and rename it over
+	watch = inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+	if(watch < 0)
+		cout << "Shader hot reload disabled, cannot watch " << directory << endl;
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher(){
+#ifdef __linux__
+	if(fd >= 0) close(fd);
+#endif
+}
+
+bool ShaderWatcher::poll(vector<string> &changed){
+	size_t before = changed.size();
+#ifdef __linux__
+	if(watch < 0) return false;
+
+	char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	for(;;){
+		ssize_t length = read(fd, buffer, sizeof(buffer));
+		if(length <= 0) break;	//EAGAIN once the queue is drained
+
+		for(char *p = buffer; p < buffer + length; ){
+			const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(p);
+			if(event->len > 0){
+				string path = directory + "/" + event->name;
+				//one save often produces several events for the same file
+				if(find(changed.begin() + before, changed.end(), path) == changed.end())
+					changed.push_back(path);
+			}
+			p += sizeof(struct inotify_event) + event->len;
+		}
+	}
+#endif
+	return changed.size() > before;
+}
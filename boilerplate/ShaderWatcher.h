@@ -0,0 +1,24 @@
+#pragma once
+#include <string>
+#include <vector>
+
+//Watches a shader directory for files that were rewritten or moved into place.
+//Uses inotify on Linux; elsewhere it never reports changes.
+class ShaderWatcher{
+public:
+	std::string directory;
+
+	ShaderWatcher(const std::string &directory);
+	~ShaderWatcher();
+
+	//Non-blocking, cheap enough to call once per frame.
+	//Appends the paths (directory/name) of files changed since the last call.
+	bool poll(std::vector<std::string> &changed);
+
+private:
+	int fd;
+	int watch;
+
+	ShaderWatcher(const ShaderWatcher &);
+	ShaderWatcher &operator=(const ShaderWatcher &);
+};
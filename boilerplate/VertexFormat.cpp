@@ -0,0 +1,87 @@
+#include "VertexFormat.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <math.h>
+
+using namespace std;
+using namespace glm;
+
+const float QUANT_MAX = 32767.f;
+
+static GLshort quantize(float value){
+	return (GLshort)roundf(glm::clamp(value, -1.f, 1.f)*QUANT_MAX);
+}
+
+//Octahedral mapping, see "A Survey of Efficient Representations for Independent Unit Vectors"
+vec2 encodeOctahedral(vec3 n){
+	n /= (abs(n.x) + abs(n.y) + abs(n.z));
+	vec2 e = vec2(n.x, n.y);
+	if(n.z < 0.f){
+		e = vec2((1.f - abs(n.y))*(n.x >= 0.f ? 1.f : -1.f),
+				 (1.f - abs(n.x))*(n.y >= 0.f ? 1.f : -1.f));
+	}
+	return e;
+}
+
+vec3 decodeOctahedral(vec2 e){
+	vec3 n = vec3(e.x, e.y, 1.f - abs(e.x) - abs(e.y));
+	if(n.z < 0.f){
+		n.x = (1.f - abs(e.y))*(e.x >= 0.f ? 1.f : -1.f);
+		n.y = (1.f - abs(e.x))*(e.y >= 0.f ? 1.f : -1.f);
+	}
+	return normalize(n);
+}
+
+GLuint pack_2_10_10_10(vec3 n){
+	GLuint x = (GLuint)((int)roundf(glm::clamp(n.x, -1.f, 1.f)*511.f) & 0x3FF);
+	GLuint y = (GLuint)((int)roundf(glm::clamp(n.y, -1.f, 1.f)*511.f) & 0x3FF);
+	GLuint z = (GLuint)((int)roundf(glm::clamp(n.z, -1.f, 1.f)*511.f) & 0x3FF);
+	return x | (y << 10) | (z << 20);
+}
+
+void QuantizeMesh(QuantizedMesh *mesh, const vector<vec3> &triangles, VertexLayout layout){
+	mesh->layout = layout;
+	mesh->vertices.resize(triangles.size() - triangles.size()%3);
+	if(mesh->vertices.empty()){
+		mesh->dequantize = mat4(1.f);
+		return;
+	}
+
+	vec3 lo = triangles[0], hi = triangles[0];
+	for(size_t i = 1; i < triangles.size(); i++){
+		lo = glm::min(lo, triangles[i]);
+		hi = glm::max(hi, triangles[i]);
+	}
+	vec3 center = (lo + hi)*.5f;
+	//flat meshes would otherwise divide by zero along one axis
+	vec3 half = glm::max((hi - lo)*.5f, vec3(1e-6f));
+	vec3 toUnit = 1.f/half;
+
+	//positions are read as plain integers, so 1/32767 is folded in here too
+	mesh->dequantize = glm::scale(glm::translate(mat4(1.f), center), half/QUANT_MAX);
+
+	for(size_t t = 0; t + 2 < triangles.size(); t += 3){
+		//same orientation as the normal built in geometry3d.glsl
+		vec3 n = cross(triangles[t+2] - triangles[t+1], triangles[t] - triangles[t+1]);
+		float length = glm::length(n);
+		n = length > 0.f ? n/length : vec3(0, 0, 1);
+
+		PackedVertex packed;
+		if(layout == LAYOUT_PACKED_2_10_10_10){
+			packed.normal.packed = pack_2_10_10_10(n);
+		}else{
+			vec2 e = encodeOctahedral(n);
+			packed.normal.octahedral[0] = quantize(e.x);
+			packed.normal.octahedral[1] = quantize(e.y);
+		}
+
+		for(int k = 0; k < 3; k++){
+			vec3 unit = (triangles[t+k] - center)*toUnit;
+			packed.position[0] = quantize(unit.x);
+			packed.position[1] = quantize(unit.y);
+			packed.position[2] = quantize(unit.z);
+			packed.position[3] = 0;
+			mesh->vertices[t+k] = packed;
+		}
+	}
+}
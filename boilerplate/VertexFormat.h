@@ -0,0 +1,34 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+
+//How the model mesh is laid out in its vertex buffer
+enum VertexLayout{
+	LAYOUT_FLOAT,				//Separate vec3 position and colour buffers, 24 bytes
+	LAYOUT_PACKED_OCTAHEDRAL,	//int16 position, octahedral normal in 2 x int16, 12 bytes
+	LAYOUT_PACKED_2_10_10_10	//int16 position, normal in GL_INT_2_10_10_10_REV, 12 bytes
+};
+
+//Interleaved quantized vertex. Positions are integers relative to the mesh
+//bounds; the matching dequantization matrix becomes the model matrix.
+struct PackedVertex{
+	GLshort position[4];		//xyz in [-32767, 32767], w unused
+	union{
+		GLshort octahedral[2];	//LAYOUT_PACKED_OCTAHEDRAL
+		GLuint packed;			//LAYOUT_PACKED_2_10_10_10
+	} normal;
+};
+
+struct QuantizedMesh{
+	std::vector<PackedVertex> vertices;
+	glm::mat4 dequantize;		//Maps integer positions back to model space
+	VertexLayout layout;
+};
+
+//Quantizes a triangle list, giving every vertex its triangle's normal
+void QuantizeMesh(QuantizedMesh *mesh, const std::vector<glm::vec3> &triangles, VertexLayout layout);
+
+glm::vec2 encodeOctahedral(glm::vec3 normal);
+glm::vec3 decodeOctahedral(glm::vec2 encoded);
+GLuint pack_2_10_10_10(glm::vec3 normal);
@@ -29,10 +29,24 @@
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
 #include <vector>
+#include <chrono>
 
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <math.h>
 #include "Camera.h"
+#include "ShaderProgram.h"
+#include "ProgramCache.h"
+#include "ShaderWatcher.h"
+#include "VertexFormat.h"
+#include "ArcLength.h"
+#include "PointGrid.h"
+#include "BSpline.h"
+#include "MeshExport.h"
+#include "ProjectFile.h"
+#include "InputRecorder.h"
+#include "Offscreen.h"
 
 using namespace std;
 using namespace glm;
@@ -48,13 +62,30 @@ string LoadSource(const string &filename);
 GLuint CompileShader(GLenum shaderType, const string &source);
 GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader);
 GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader, GLuint geoShader);
+GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader, GLuint geoShader, GLuint tessControlShader, GLuint tessEvalShader);
 
 int iterations = 0;
 char shape = 0;
 
+// linked programs are reused from here when the sources have not changed
+ProgramCache* programCache = 0;
+
 // --------------------------------------------------------------------------
 // Functions to set up OpenGL shader programs for rendering
 
+// a previously linked program built from exactly these sources, or 0; key is
+// set either way so the freshly linked program can be stored under it
+GLuint LoadCachedProgram(const vector<string> &sources, uint64_t *key)
+{
+	*key = programCache ? programCache->key(sources) : 0;
+	return programCache ? programCache->load(*key) : 0;
+}
+
+void StoreCachedProgram(uint64_t key, GLuint program)
+{
+	if (programCache) programCache->store(key, program);
+}
+
 // load, compile, and link shaders, returning true if successful
 GLuint InitializeShaders(string vert, string frag)
 {
@@ -63,6 +94,11 @@ GLuint InitializeShaders(string vert, string frag)
 	string fragmentSource = LoadSource(frag);
 	if (vertexSource.empty() || fragmentSource.empty()) return false;
 
+	// skip compiling entirely if this exact program was linked before
+	uint64_t key;
+	GLuint cached = LoadCachedProgram({ vertexSource, fragmentSource }, &key);
+	if (cached) return cached;
+
 	// compile shader source into shader objects
 	GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
 	GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
@@ -73,6 +109,8 @@ GLuint InitializeShaders(string vert, string frag)
 	glDeleteShader(vertex);
 	glDeleteShader(fragment);
 
+	StoreCachedProgram(key, program);
+
 	// check for OpenGL errors and return false if error occurred
 	return program;
 }
@@ -85,6 +123,11 @@ GLuint InitializeShaders(string vert, string frag, string geo)
 	string geoSource = LoadSource(geo);
 	if (vertexSource.empty() || fragmentSource.empty() || geoSource.empty()) return false;
 
+	// skip compiling entirely if this exact program was linked before
+	uint64_t key;
+	GLuint cached = LoadCachedProgram({ vertexSource, fragmentSource, geoSource }, &key);
+	if (cached) return cached;
+
 	// compile shader source into shader objects
 	GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
 	GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
@@ -97,10 +140,109 @@ GLuint InitializeShaders(string vert, string frag, string geo)
 	glDeleteShader(fragment);
 	glDeleteShader(geometry);
 
+	StoreCachedProgram(key, program);
+
 	// check for OpenGL errors and return false if error occurred
 	return program;
 }
 
+GLuint InitializeShaders(string vert, string frag, string geo, string tessControl, string tessEval)
+{
+	// load shader source from files
+	string vertexSource = LoadSource(vert);
+	string fragmentSource = LoadSource(frag);
+	string geoSource = LoadSource(geo);
+	string tessControlSource = LoadSource(tessControl);
+	string tessEvalSource = LoadSource(tessEval);
+	if (vertexSource.empty() || fragmentSource.empty() || geoSource.empty()
+		|| tessControlSource.empty() || tessEvalSource.empty()) return false;
+
+	// skip compiling entirely if this exact program was linked before
+	uint64_t key;
+	GLuint cached = LoadCachedProgram({ vertexSource, fragmentSource, geoSource, tessControlSource, tessEvalSource }, &key);
+	if (cached) return cached;
+
+	// compile shader source into shader objects
+	GLuint vertex = CompileShader(GL_VERTEX_SHADER, vertexSource);
+	GLuint fragment = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+	GLuint geometry = CompileShader(GL_GEOMETRY_SHADER, geoSource);
+	GLuint control = CompileShader(GL_TESS_CONTROL_SHADER, tessControlSource);
+	GLuint evaluation = CompileShader(GL_TESS_EVALUATION_SHADER, tessEvalSource);
+
+	// link shader program
+	GLuint program = LinkProgram(vertex, fragment, geometry, control, evaluation);
+
+	glDeleteShader(vertex);
+	glDeleteShader(fragment);
+	glDeleteShader(geometry);
+	glDeleteShader(control);
+	glDeleteShader(evaluation);
+
+	StoreCachedProgram(key, program);
+
+	// check for OpenGL errors and return false if error occurred
+	return program;
+}
+
+// --------------------------------------------------------------------------
+// Shader hot reload
+
+// source files a program was built from, so it can be rebuilt when they change
+struct ProgramSources
+{
+	ShaderProgram *program;
+	string vert, frag, geo;		// geo is empty if there is no geometry stage
+	string tessControl, tessEval;	// both empty if there is no tessellation
+
+	ProgramSources(ShaderProgram *program, string vert, string frag, string geo = "",
+		string tessControl = "", string tessEval = "")
+		: program(program), vert(vert), frag(frag), geo(geo), tessControl(tessControl), tessEval(tessEval)
+	{}
+
+	bool uses(const vector<string> &files) const
+	{
+		string stages[5] = { vert, frag, geo, tessControl, tessEval };
+		for (int i = 0; i < 5; i++) {
+			if (!stages[i].empty() && find(files.begin(), files.end(), stages[i]) != files.end())
+				return true;
+		}
+		return false;
+	}
+};
+
+// rebuilds every program that uses one of the changed files and swaps it in
+// between frames; a program that fails to compile or link is discarded and
+// the previous one stays in use (the log has already been printed)
+void ReloadPrograms(vector<ProgramSources> &programs, const vector<string> &changed)
+{
+	for (unsigned int i = 0; i < programs.size(); i++) {
+		ProgramSources &sources = programs[i];
+		if (!sources.uses(changed)) continue;
+
+		GLuint rebuilt;
+		if (!sources.tessControl.empty())
+			rebuilt = InitializeShaders(sources.vert, sources.frag, sources.geo, sources.tessControl, sources.tessEval);
+		else if (!sources.geo.empty())
+			rebuilt = InitializeShaders(sources.vert, sources.frag, sources.geo);
+		else
+			rebuilt = InitializeShaders(sources.vert, sources.frag);
+
+		GLint status = GL_FALSE;
+		if (rebuilt) glGetProgramiv(rebuilt, GL_LINK_STATUS, &status);
+		if (status == GL_FALSE) {
+			if (rebuilt) glDeleteProgram(rebuilt);
+			cout << "Reload of " << sources.vert << " + " << sources.frag
+				<< " failed, keeping previous program" << endl;
+			continue;
+		}
+
+		glDeleteProgram(sources.program->id);
+		sources.program->attach(rebuilt);
+		sources.program->bindBlock("FrameData", FRAME_UNIFORM_BINDING);
+		cout << "Reloaded " << sources.vert << " + " << sources.frag << endl;
+	}
+}
+
 // --------------------------------------------------------------------------
 // Functions to set up OpenGL buffers for storing geometry data
 
@@ -184,6 +326,58 @@ bool LoadGeometry(Geometry *geometry, vec3 *vertices, vec3 *colours, int element
 	return !CheckGLErrors();
 }
 
+// sets up a single interleaved buffer of PackedVertex, colour comes from a uniform
+bool InitializePackedVAO(Geometry *geometry, VertexLayout layout)
+{
+	const GLuint VERTEX_INDEX = 0;
+	const GLuint NORMAL_INDEX = 1;
+
+	glGenBuffers(1, &geometry->vertexBuffer);
+	glGenVertexArrays(1, &geometry->vertexArray);
+	glBindVertexArray(geometry->vertexArray);
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
+
+	// positions are plain integers, the model matrix scales them back
+	glVertexAttribPointer(
+		VERTEX_INDEX,		//Attribute index
+		3, 					//# of components
+		GL_SHORT, 			//Type of component
+		GL_FALSE, 			//Should be normalized?
+		sizeof(PackedVertex),	//Stride
+		(void*)offsetof(PackedVertex, position));	//Offset to first element
+	glEnableVertexAttribArray(VERTEX_INDEX);
+
+	if (layout == LAYOUT_PACKED_2_10_10_10) {
+		glVertexAttribPointer(NORMAL_INDEX, 4, GL_INT_2_10_10_10_REV, GL_TRUE,
+			sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+	} else {
+		glVertexAttribPointer(NORMAL_INDEX, 2, GL_SHORT, GL_FALSE,
+			sizeof(PackedVertex), (void*)offsetof(PackedVertex, normal));
+	}
+	glEnableVertexAttribArray(NORMAL_INDEX);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	return !CheckGLErrors();
+}
+
+bool LoadPackedGeometry(Geometry *geometry, const PackedVertex *vertices, unsigned int count)
+{
+	geometry->elementCount = count;
+
+	glBindBuffer(GL_ARRAY_BUFFER, geometry->vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(PackedVertex)*count, vertices, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	return !CheckGLErrors();
+}
+
+bool LoadPackedGeometry(Geometry *geometry, const QuantizedMesh &mesh)
+{
+	return LoadPackedGeometry(geometry, mesh.vertices.data(), mesh.vertices.size());
+}
+
 // deallocate geometry-related objects
 void DestroyGeometry(Geometry *geometry)
 {
@@ -194,6 +388,221 @@ void DestroyGeometry(Geometry *geometry)
 	glDeleteBuffers(1, &geometry->colourBuffer);
 }
 
+// --------------------------------------------------------------------------
+// Offscreen layer caching the curves that are not being edited
+
+// what the frame ends up in: the window, or the offscreen target when headless
+GLuint screen_framebuffer = 0;
+
+struct CurveLayer
+{
+	// OpenGL names for the framebuffer, its colour texture and the empty
+	// vertex array used to draw the full-screen quad
+	GLuint  framebuffer;
+	GLuint  texture;
+	GLuint  quadArray;
+	int     width, height;
+
+	// edit mode the layer was built for, and how many points of each curve
+	// have been rasterized into it so far
+	int     mode;
+	unsigned int cached[3];
+	bool    valid;
+
+	// while a point is dragged the segments around it are left out of the
+	// layer and drawn live instead
+	int     dragCurve;
+	unsigned int dragFirst, dragLast;
+
+	CurveLayer() : framebuffer(0), texture(0), quadArray(0), width(0), height(0), mode(0), valid(false),
+		dragCurve(-1), dragFirst(0), dragLast(0)
+	{
+		cached[0] = cached[1] = cached[2] = 0;
+	}
+};
+
+bool InitializeCurveLayer(CurveLayer *layer, int width, int height)
+{
+	layer->width = width;
+	layer->height = height;
+
+	glGenTextures(1, &layer->texture);
+	glBindTexture(GL_TEXTURE_2D, layer->texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &layer->framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, layer->framebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, layer->texture, 0);
+	bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+	glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
+
+	// core profile needs a vertex array bound even though the quad has no attributes
+	glGenVertexArrays(1, &layer->quadArray);
+
+	if (!complete)
+		cout << "Curve layer framebuffer is incomplete" << endl;
+	return complete && !CheckGLErrors();
+}
+
+// forces the next frame to rebuild the layer from scratch
+void InvalidateCurveLayer(CurveLayer *layer)
+{
+	layer->valid = false;
+}
+
+void DestroyCurveLayer(CurveLayer *layer)
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
+	glDeleteFramebuffers(1, &layer->framebuffer);
+	glDeleteTextures(1, &layer->texture);
+	glDeleteVertexArrays(1, &layer->quadArray);
+}
+
+// draws the cached layer over the whole viewport with a single quad
+void CompositeCurveLayer(CurveLayer *layer, ShaderProgram *program)
+{
+	glUseProgram(program->id);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_2D, layer->texture);
+	glUniform1i(program->uniform("layer"), 0);
+
+	glDisable(GL_DEPTH_TEST);
+	glBindVertexArray(layer->quadArray);
+	glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+	glEnable(GL_DEPTH_TEST);
+
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glUseProgram(0);
+
+	CheckGLErrors();
+}
+
+// --------------------------------------------------------------------------
+// Sweep surface evaluated on the GPU by the tessellation stages
+
+// parameter samples covered by one patch before tessellation, per direction
+const int SWEEP_SAMPLES_PER_PATCH = 16;
+
+struct SweepPatches
+{
+	// buffer textures holding the sampled curves, see shaders/tesseval.glsl
+	GLuint  rowBuffer, rowTexture;
+	GLuint  profileBuffer, profileTexture;
+	// attribute-less vertex array, one vertex per patch
+	GLuint  vertexArray;
+	int     rowCount, profileCount;
+
+	SweepPatches() : rowBuffer(0), rowTexture(0), profileBuffer(0), profileTexture(0),
+		vertexArray(0), rowCount(0), profileCount(0)
+	{}
+};
+
+bool InitializeSweepPatches(SweepPatches *sweep)
+{
+	glGenBuffers(1, &sweep->rowBuffer);
+	glGenBuffers(1, &sweep->profileBuffer);
+	glGenTextures(1, &sweep->rowTexture);
+	glGenTextures(1, &sweep->profileTexture);
+	glGenVertexArrays(1, &sweep->vertexArray);
+	return !CheckGLErrors();
+}
+
+// uploads only the sampled curves, rows are paired by index like the CPU mesh
+bool LoadSweepPatches(SweepPatches *sweep, const vector<vec2> &curve1, const vector<vec2> &curve2, const vector<vec2> &curve3)
+{
+	vector<vec4> rows(std::min(curve1.size(), curve2.size()));
+	for (unsigned int i = 0; i < rows.size(); i++)
+		rows[i] = vec4(curve1[i], curve2[i]);
+	sweep->rowCount = rows.size();
+	sweep->profileCount = curve3.size();
+
+	glBindBuffer(GL_TEXTURE_BUFFER, sweep->rowBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(vec4)*rows.size(), rows.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, sweep->profileBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, sizeof(vec2)*curve3.size(), curve3.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+	glBindTexture(GL_TEXTURE_BUFFER, sweep->rowTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, sweep->rowBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, sweep->profileTexture);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32F, sweep->profileBuffer);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+
+	return !CheckGLErrors();
+}
+
+// camera and viewport come from the frame uniform buffer
+void RenderSweepPatches(SweepPatches *sweep, ShaderProgram *program, vec3 colour, float pixelsPerSegment)
+{
+	if (sweep->rowCount < 1 || sweep->profileCount < 2) return;
+
+	// row parameter spans both halves, see sweep() in the shaders
+	int patchesU = (2*sweep->rowCount-1 + SWEEP_SAMPLES_PER_PATCH-1)/SWEEP_SAMPLES_PER_PATCH;
+	int patchesV = (sweep->profileCount-1 + SWEEP_SAMPLES_PER_PATCH-1)/SWEEP_SAMPLES_PER_PATCH;
+
+	glUseProgram(program->id);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, sweep->rowTexture);
+	glActiveTexture(GL_TEXTURE1);
+	glBindTexture(GL_TEXTURE_BUFFER, sweep->profileTexture);
+	glUniform1i(program->uniform("rows"), 0);
+	glUniform1i(program->uniform("profile"), 1);
+	glUniform2i(program->uniform("patchGrid"), patchesU, patchesV);
+	glUniform1f(program->uniform("pixelsPerSegment"), pixelsPerSegment);
+	glUniform3f(program->uniform("surfaceColour"), colour.r, colour.g, colour.b);
+
+	glPatchParameteri(GL_PATCH_VERTICES, 1);
+	glBindVertexArray(sweep->vertexArray);
+	glDrawArrays(GL_PATCHES, 0, patchesU*patchesV);
+
+	glBindVertexArray(0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindTexture(GL_TEXTURE_BUFFER, 0);
+	glUseProgram(0);
+
+	CheckGLErrors();
+}
+
+void DestroySweepPatches(SweepPatches *sweep)
+{
+	glDeleteTextures(1, &sweep->rowTexture);
+	glDeleteTextures(1, &sweep->profileTexture);
+	glDeleteBuffers(1, &sweep->rowBuffer);
+	glDeleteBuffers(1, &sweep->profileBuffer);
+	glDeleteVertexArrays(1, &sweep->vertexArray);
+}
+
+// --------------------------------------------------------------------------
+// Uniform buffer holding the per-frame data shared by all programs
+
+GLuint InitializeFrameUniforms()
+{
+	GLuint buffer = 0;
+	glGenBuffers(1, &buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), 0, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// every program binds its FrameData block to this same binding point
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, buffer);
+	return buffer;
+}
+
+// uploads the frame data once, before any draws that use it
+void UpdateFrameUniforms(GLuint buffer, const FrameUniforms &frame)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &frame);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
 // --------------------------------------------------------------------------
 // Rendering function that draws our scene to the frame buffer
 
@@ -214,26 +623,18 @@ void RenderScene(Geometry *geometry, GLuint program)
 	CheckGLErrors();
 }
 
-void RenderScene(Geometry *geometry, GLuint program, vec3 color, Camera* camera, mat4 perspectiveMatrix, GLenum rendermode)
+// camera and light come from the frame uniform buffer, see UpdateFrameUniforms
+void RenderScene(Geometry *geometry, ShaderProgram *program, vec3 color, GLenum rendermode)
 {
 
 	// bind our shader program and the vertex array object containing our
 	// scene geometry, then tell OpenGL to draw our geometry
-	glUseProgram(program);
+	glUseProgram(program->id);
 
-	int vp [4];
-	glGetIntegerv(GL_VIEWPORT, vp);
-	//int width = vp[2];
-	//int height = vp[3];
-
-
-	//Bind uniforms
-	GLint uniformLocation = glGetUniformLocation(program, "Colour");
-	glUniform3f(uniformLocation, color.r, color.g, color.b); 
-
-	mat4 modelViewProjection = perspectiveMatrix*camera->viewMatrix();
-	uniformLocation = glGetUniformLocation(program, "modelViewProjection");
-	glUniformMatrix4fv(uniformLocation, 1, false, glm::value_ptr(modelViewProjection));
+	//Bind uniforms, locations were looked up when the program was linked
+	GLint uniformLocation = program->uniform("Colour");
+	if (uniformLocation != -1)
+		glUniform3f(uniformLocation, color.r, color.g, color.b);
 
 	glBindVertexArray(geometry->vertexArray);
 	glDrawArrays(rendermode, 0, geometry->elementCount);
@@ -246,6 +647,24 @@ void RenderScene(Geometry *geometry, GLuint program, vec3 color, Camera* camera,
 	CheckGLErrors();
 }
 
+// draws a quantized mesh; camera and light come from the frame uniform buffer
+void RenderPackedScene(Geometry *geometry, ShaderProgram *program, const QuantizedMesh &mesh, vec3 color)
+{
+	glUseProgram(program->id);
+
+	glUniformMatrix4fv(program->uniform("model"), 1, GL_FALSE, glm::value_ptr(mesh.dequantize));
+	glUniform1i(program->uniform("octahedral"), mesh.layout == LAYOUT_PACKED_OCTAHEDRAL ? 1 : 0);
+	glUniform3f(program->uniform("surfaceColour"), color.r, color.g, color.b);
+
+	glBindVertexArray(geometry->vertexArray);
+	glDrawArrays(GL_TRIANGLES, 0, geometry->elementCount);
+
+	glBindVertexArray(0);
+	glUseProgram(0);
+
+	CheckGLErrors();
+}
+
 // --------------------------------------------------------------------------
 // GLFW callback functions
 
@@ -256,15 +675,32 @@ void ErrorCallback(int error, const char* description)
 	cout << description << endl;
 }
 
+// headless there is no window to close, escape sets this instead
+bool quit = false;
+
 // handles keyboard input events
 int press = 1;
 bool clear = false;
 bool render_model = false;
+//set whenever the curves or generation parameters change after the model was built
+bool model_stale = true;
+bool tessellate = false;
+VertexLayout model_layout = LAYOUT_PACKED_OCTAHEDRAL;
+bool relayout = false;
+//rows along the base curves, both are resampled by arc length to this many
+int model_rows = 100;
+//-1, or the format the model is to be exported in next frame
+int export_format = -1;
+//F5 saves and F9 reopens the project
+const char* project_path = "project.sweep";
+bool save_project = false;
+bool load_project = false;
 void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
 	if (action == GLFW_PRESS) {
 		if(key == GLFW_KEY_ESCAPE) {
-			glfwSetWindowShouldClose(window, GL_TRUE);
+			if(window) glfwSetWindowShouldClose(window, GL_TRUE);
+			else quit = true;
 		}
 		if(key == GLFW_KEY_1) {
 			press = 1;
@@ -273,21 +709,43 @@ void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
 		} else if(key == GLFW_KEY_3) {
 			press = 3;
 		} else if(key == GLFW_KEY_4) {
-			render_model = true;
+			render_model = model_stale;
 			press = 4;
 		} else if(key == GLFW_KEY_C) {
 			clear = true;
+		} else if(key == GLFW_KEY_T) {
+			tessellate = !tessellate;
+		} else if(key == GLFW_KEY_V) {
+			//cycle float -> octahedral -> 2_10_10_10
+			model_layout = (VertexLayout)((model_layout + 1) % 3);
+			relayout = true;
+		} else if(key == GLFW_KEY_EQUAL || key == GLFW_KEY_MINUS) {
+			model_rows = std::min((int)PROJECT_MAX_MODEL_ROWS, std::max(2, model_rows + (key == GLFW_KEY_EQUAL ? 10 : -10)));
+			cout << "Model rows: " << model_rows << endl;
+			model_stale = true;
+			if(press == 4) render_model = true;
+		} else if(key == GLFW_KEY_E) {
+			export_format = EXPORT_STL;
+		} else if(key == GLFW_KEY_P) {
+			export_format = EXPORT_PLY;
+		} else if(key == GLFW_KEY_O) {
+			export_format = EXPORT_OBJ;
+		} else if(key == GLFW_KEY_F5) {
+			save_project = true;
+		} else if(key == GLFW_KEY_F9) {
+			load_project = true;
 		}
 	}
 }
 
-void get_open_curve(vector<vec3>* points, vector<vec3>* colours, vector<vec2>* inp, vec3 inc) {
+//first and last let only part of a curve be converted, between those points
+void get_open_curve(vector<vec3>* points, vector<vec3>* colours, vector<vec2>* inp, vec3 inc, unsigned int first = 0, unsigned int last = UINT_MAX) {
 	points->clear();
 	colours->clear();
-	if(inp->size() == 0) return;
-	points->push_back(vec3(inp->at(0).x, inp->at(0).y, 0));
+	if(inp->size() <= first) return;
+	points->push_back(vec3(inp->at(first).x, inp->at(first).y, 0));
 	colours->push_back(inc);
-	for(unsigned int i = 1; i < inp->size(); i++) {
+	for(unsigned int i = first+1; i < inp->size() && i <= last; i++) {
 		points->push_back(vec3(inp->at(i).x, inp->at(i).y, 0));
 		points->push_back(vec3(inp->at(i).x, inp->at(i).y, 0));
 		colours->push_back(inc);
@@ -322,24 +780,6 @@ void ScrollCallback(GLFWwindow* window, double x, double y) {
 	}
 }
 
-float deBoor(int i, float u, int order, float knots[]) {
-	if(order == 1) {
-		if(knots[i] <= u && u < knots[i+1]) {
-			return 1.f;
-		} else {
-			return 0.f;
-		}
-	}
-	float value = 0;
-	float den = knots[i+order-1]-knots[i];
-	if(den != 0)
-	value += (u-knots[i])/(den) * deBoor(i, u, order-1, knots);
-	den = knots[i+order]-knots[i+1];
-	if(den != 0)
-	value += (knots[i+order]-u)/(den) * deBoor(i+1, u, order-1, knots);
-	return value;
-}
-
 void spline(vector<vec2>* out, vector<vec2>* in) {
 	float knots[in->size()+3];
 	knots[0] = 0.f;
@@ -350,14 +790,12 @@ void spline(vector<vec2>* out, vector<vec2>* in) {
 	}
 	knots[in->size()+1] = 1.f;
 	knots[in->size()+2] = 1.f;
+	//step up to and including u = 1, the order is only looked at once per curve
 	float step = 0.01f;
-	for(float u = step; u < 1.f; u+=step) {
-		vec2 point = vec2(0, 0);
-		for(unsigned int i = 0; i < in->size(); i++) {
-			point += in->at(i)*deBoor(i, u, 2, knots);
-		}
-		out->push_back(point);
-	}
+	int samples = (int)(1.f/step + .5f);
+	unsigned int first = out->size();
+	out->resize(first + samples);
+	SampleBSpline<2, float>(2, in->data(), in->size(), knots, step, step, samples, out->data() + first);
 }
 void smooth(vector<vec2>* out, vector<vec2>* in) {
 	for(unsigned int i = 1; i < in->size()-1; i++) {
@@ -365,54 +803,253 @@ void smooth(vector<vec2>* out, vector<vec2>* in) {
 		out->push_back(point);
 	}
 }
+//spline and smooth the drawn curves, the base curves are then paired by
+//distance along them rather than by sample index
+void GenerateModelCurves(vector<vec2>* points, vector<vec2>* points2, vector<vec2>* points3, int rows,
+	vector<vec2>* curve1, vector<vec2>* curve2, vector<vec2>* curve3) {
+	vector<vec2> curve21;
+	vector<vec2> curve22;
+	vector<vec2> curve23;
+	spline(&curve21, points);
+	spline(&curve22, points2);
+	spline(&curve23, points3);
+	vector<vec2> smooth1;
+	vector<vec2> smooth2;
+	smooth(&smooth1, &curve21);
+	smooth(&smooth2, &curve22);
+	smooth(curve3, &curve23);
+	
+	ArcLength(smooth1).resample(curve1, rows);
+	ArcLength(smooth2).resample(curve2, rows);
+}
+
+//sweeps the bump curve between the base curves, one row per base curve
+//point, then again in reverse mirrored below z = 0
+void BuildSurfaceGrid(SurfaceGrid* surface, const vector<vec2>& curve1, const vector<vec2>& curve2, const vector<vec2>& curve3) {
+	unsigned int itt = std::min(curve1.size(), curve2.size());
+	surface->points.clear();
+	surface->points.reserve(2*itt*curve3.size());
+	surface->rows = 2*itt;
+	surface->columns = curve3.size();
+	for(unsigned int r = 0; r < 2*itt; r++) {
+		unsigned int i = (r < itt) ? r : 2*itt-1-r;
+		float side = (r < itt) ? 2.f : -2.f;
+		float scale = abs(curve1[i].x - curve2[i].x) + abs(curve1[i].y - curve2[i].y);
+		for(unsigned int j = 0; j < curve3.size(); j++) {
+			float foo = (float)j/((float)curve3.size()-1);
+			vec3 point1 = vec3();
+			point1.x = curve3[j].x*scale + ((1-foo)*curve1[i].x + (foo)*curve2[i].x);
+			point1.y = 2*((1-foo)*curve1[i].y + (foo)*curve2[i].y);
+			point1.z = side*(curve3[j].y*scale - ((curve3[0].y*scale*(1-foo)) + (curve3[curve3.size()-1].y*scale*(foo))));
+			surface->points.push_back(point1);
+		}
+	}
+}
+
+//make points into triangles, two per grid cell
+void TriangulateSurface(vector<vec3>* mesh, vector<vec3>* colours, const SurfaceGrid& surface, vec3 colour) {
+	mesh->clear();
+	colours->clear();
+	mesh->reserve(3*surface.triangles());
+	for(unsigned int i = 0; i + 1 < surface.rows; i++) {
+		const vec3* row = &surface.points[i*surface.columns];
+		const vec3* next = row + surface.columns;
+		for(unsigned int j = 0; j + 1 < surface.columns; j++) {
+			mesh->push_back(row[j]);
+			mesh->push_back(row[j+1]);
+			mesh->push_back(next[j]);
+			
+			mesh->push_back(next[j]);
+			mesh->push_back(row[j+1]);
+			mesh->push_back(next[j+1]);
+		}
+	}
+	colours->assign(mesh->size(), colour);
+}
+// builds the model of a project without opening a window and exports it,
+// straight from the cached surface when the project has one
+int ExportProject(const char* projectPath, const char* meshPath)
+{
+	ExportFormat format;
+	if (!ExportFormatFromPath(meshPath, &format)) {
+		cout << "Unknown export format for " << meshPath << endl;
+		return -1;
+	}
+	ProjectFile project;
+	if (!project.open(projectPath)) {
+		cout << "Failed to open project " << projectPath << endl;
+		return -1;
+	}
+
+	const ProjectHeader* header = project.header();
+	SurfaceGrid surface;
+	if (project.surface()) {
+		surface.rows = header->surfaceRows;
+		surface.columns = header->surfaceColumns;
+		surface.points.assign(project.surface(), project.surface() + header->surface.count);
+	} else {
+		vector<vec2> points[3];
+		for (int c = 0; c < 3; c++) {
+			unsigned int count;
+			const vec2* curve = project.curve(c, &count);
+			if (count < 3) {
+				cout << "Project " << projectPath << " has no model to export" << endl;
+				return -1;
+			}
+			points[c].assign(curve, curve + count);
+		}
+		vector<vec2> curve1, curve2, curve3;
+		GenerateModelCurves(&points[0], &points[1], &points[2], header->modelRows, &curve1, &curve2, &curve3);
+		BuildSurfaceGrid(&surface, curve1, curve2, curve3);
+	}
+
+	if (!ExportSurface(surface, format, meshPath)) {
+		cout << "Failed to export " << meshPath << endl;
+		return -1;
+	}
+	cout << "Exported " << surface.triangles() << " triangles to " << meshPath << endl;
+	return 0;
+}
+
 // ==========================================================================
 // PROGRAM ENTRY POINT
 
 int main(int argc, char *argv[])
 {
-	// initialize the GLFW windowing system
-	if (!glfwInit()) {
-		cout << "ERROR: GLFW failed to initialize, TERMINATING" << endl;
+	// boilerplate.out [project] [--export model.stl|.ply|.obj]
+	//                 [--record input.rec | --replay input.rec [--fast]]
+	//                 [--headless [--frames N] [--capture prefix]]
+	const char* exportPath = 0;
+	const char* recordPath = 0;
+	const char* replayPath = 0;
+	const char* capturePrefix = 0;
+	bool fastReplay = false;
+	bool headless = false;
+	int frameLimit = 0;
+	for (int i = 1; i < argc; i++) {
+		if (string(argv[i]) == "--export" && i+1 < argc) {
+			exportPath = argv[++i];
+		} else if (string(argv[i]) == "--record" && i+1 < argc) {
+			recordPath = argv[++i];
+		} else if (string(argv[i]) == "--replay" && i+1 < argc) {
+			replayPath = argv[++i];
+		} else if (string(argv[i]) == "--fast") {
+			fastReplay = true;
+		} else if (string(argv[i]) == "--headless") {
+			headless = true;
+		} else if (string(argv[i]) == "--frames" && i+1 < argc) {
+			frameLimit = atoi(argv[++i]);
+		} else if (string(argv[i]) == "--capture" && i+1 < argc) {
+			capturePrefix = argv[++i];
+		} else {
+			project_path = argv[i];
+			load_project = true;
+		}
+	}
+	if (exportPath)
+		return ExportProject(project_path, exportPath);
+	// headless there is no window to close and nobody to press escape
+	if (headless && !replayPath && frameLimit <= 0) {
+		cout << "--headless needs --replay or --frames N to know when to stop" << endl;
 		return -1;
 	}
-	glfwSetErrorCallback(ErrorCallback);
+	if (headless && recordPath)
+		cout << "Ignoring --record, there is no live input when headless" << endl;
 
-	// attempt to create a window with an OpenGL 4.1 core profile context
-	GLFWwindow *window = 0;
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 	int width = 512*2, height = 512*2;
-	window = glfwCreateWindow(width, height, "CPSC 453 OpenGL Boilerplate", 0, 0);
-	if (!window) {
-		cout << "Program failed to create GLFW window, TERMINATING" << endl;
-		glfwTerminate();
-		return -1;
+	GLFWwindow *window = 0;
+	OffscreenContext offscreen;
+	OffscreenTarget target;
+	GLADloadproc loader = (GLADloadproc)glfwGetProcAddress;
+	if (headless) {
+		// no window or display, the frame goes into an FBO instead
+		if (!offscreen.create()) {
+			cout << "Program failed to create an offscreen context, TERMINATING" << endl;
+			return -1;
+		}
+		loader = offscreen.loader();
+	} else {
+		// initialize the GLFW windowing system
+		if (!glfwInit()) {
+			cout << "ERROR: GLFW failed to initialize, TERMINATING" << endl;
+			return -1;
+		}
+		glfwSetErrorCallback(ErrorCallback);
+
+		// attempt to create a window with an OpenGL 4.1 core profile context
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+		glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+		glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+		glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+		window = glfwCreateWindow(width, height, "CPSC 453 OpenGL Boilerplate", 0, 0);
+		if (!window) {
+			cout << "Program failed to create GLFW window, TERMINATING" << endl;
+			glfwTerminate();
+			return -1;
+		}
 	}
 
-	// set keyboard callback function and make our context current (active)
-	glfwSetKeyCallback(window, KeyCallback);
-	glfwSetScrollCallback(window, ScrollCallback);
-	glfwMakeContextCurrent(window);
+	// all input goes through the recorder so it can be logged or replayed,
+	// headless it only ever comes from a replay
+	InputRecorder input(KeyCallback, ScrollCallback);
+	if (recordPath && !headless && !input.record(recordPath))
+		cout << "Failed to open " << recordPath << " for recording" << endl;
+	if (replayPath && !input.replay(replayPath, fastReplay)) {
+		cout << "Failed to read input recording " << replayPath << endl;
+		if (window) glfwTerminate();
+		return -1;
+	}
+	if (window) {
+		input.attach(window);
+		glfwMakeContextCurrent(window);
+		// a fast replay is not held back by vsync either
+		if (input.replaying() && fastReplay)
+			glfwSwapInterval(0);
+	}
 
 	//Intialize GLAD
-	if (!gladLoadGL())
+	if (!gladLoadGLLoader(loader))
 	{
 		cout << "GLAD init failed" << endl;
 		return -1;
 	}
 
+	if (headless) {
+		if (!InitializeOffscreenTarget(&target, width, height))
+			return -1;
+		screen_framebuffer = target.framebuffer;
+	}
+
 	// query and print out information about our OpenGL environment
 	QueryGLVersion();
 
 	// call function to load and compile shader programs
-	GLuint program = InitializeShaders("shaders/vertex.glsl", "shaders/fragment.glsl");
-	GLuint program3d = InitializeShaders("shaders/vertex3d.glsl", "shaders/fragment3d.glsl", "shaders/geometry3d.glsl");
-	if (program == 0 || program3d == 0) {
+	ProgramCache cache("shadercache", loader);
+	programCache = &cache;
+	ShaderProgram program(InitializeShaders("shaders/vertex.glsl", "shaders/fragment.glsl"));
+	ShaderProgram program3d(InitializeShaders("shaders/vertex3d.glsl", "shaders/fragment3d.glsl", "shaders/geometry3d.glsl"));
+	ShaderProgram programLayer(InitializeShaders("shaders/vertexlayer.glsl", "shaders/fragmentlayer.glsl"));
+	ShaderProgram programPacked(InitializeShaders("shaders/vertexpacked.glsl", "shaders/fragment3d.glsl"));
+	ShaderProgram programTess(InitializeShaders("shaders/vertextess.glsl", "shaders/fragment3d.glsl", "shaders/geometry3d.glsl",
+		"shaders/tesscontrol.glsl", "shaders/tesseval.glsl"));
+	if (program.id == 0 || program3d.id == 0 || programLayer.id == 0 || programTess.id == 0 || programPacked.id == 0) {
 		cout << "Program could not initialize shaders, TERMINATING" << endl;
 		return -1;
 	}
+	program3d.bindBlock("FrameData", FRAME_UNIFORM_BINDING);
+	programTess.bindBlock("FrameData", FRAME_UNIFORM_BINDING);
+	programPacked.bindBlock("FrameData", FRAME_UNIFORM_BINDING);
+	GLuint frameUniformBuffer = InitializeFrameUniforms();
+
+	// programs are rebuilt whenever one of their files in shaders/ is saved
+	vector<ProgramSources> reloadable;
+	reloadable.push_back(ProgramSources(&program, "shaders/vertex.glsl", "shaders/fragment.glsl"));
+	reloadable.push_back(ProgramSources(&program3d, "shaders/vertex3d.glsl", "shaders/fragment3d.glsl", "shaders/geometry3d.glsl"));
+	reloadable.push_back(ProgramSources(&programLayer, "shaders/vertexlayer.glsl", "shaders/fragmentlayer.glsl"));
+	reloadable.push_back(ProgramSources(&programPacked, "shaders/vertexpacked.glsl", "shaders/fragment3d.glsl"));
+	reloadable.push_back(ProgramSources(&programTess, "shaders/vertextess.glsl", "shaders/fragment3d.glsl", "shaders/geometry3d.glsl",
+		"shaders/tesscontrol.glsl", "shaders/tesseval.glsl"));
+	ShaderWatcher watcher("shaders");
 	glEnable(GL_DEPTH_TEST);
 	glDepthFunc(GL_LEQUAL);
 	
@@ -425,8 +1062,13 @@ int main(int argc, char *argv[])
 	vector<vec2> points3;
 	vec3 p3_colour = vec3(0, 1, 1);
 	
+	vector<vec2>* curves[3] = {&points, &points2, &points3};
+	vec3 curve_colours[3] = {p1_colour, p2_colour, p3_colour};
+	
 	vector<vec3> pointsm;
 	vec3 pm_colour = vec3(1, 1, 1);
+	//the model before triangulation, kept for exporting
+	SurfaceGrid surface;
 	
 	vector<vec3> colours;
 	
@@ -440,8 +1082,6 @@ int main(int argc, char *argv[])
 	float scrollSpeed = 0.05f;
 	scrollsens = &scrollSpeed;
 	vec3 light = cam.pos;//vec3(-1, 1, 0);
-	GLint cameraGL = glGetUniformLocation(program3d, "cameraPos");
-	GLint lightGL = glGetUniformLocation(program, "light");
 	
 	// call function to create and fill buffers with geometry data
 	Geometry geometry;
@@ -451,139 +1091,275 @@ int main(int argc, char *argv[])
 	if(!LoadGeometry(&geometry, pointsm.data(), colours.data(), pointsm.size()))
 		cout << "Failed to load geometry" << endl;
 
+	// curves that are not being drawn are rasterized once into this layer
+	CurveLayer layer;
+	int fbWidth = width, fbHeight = height;
+	if (window)
+		glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+	if (!InitializeCurveLayer(&layer, fbWidth, fbHeight))
+		cout << "Program failed to initialize curve layer!" << endl;
+
+	// control points of all three curves, for picking with the right button
+	PointGrid grid(vec2(-1.f), vec2(1.f), 64);
+	PointRef dragged;
+	float pickRadius = 0.03f;
+
+	// only the sampled curves are uploaded for the tessellated surface
+	SweepPatches sweep;
+	if (!InitializeSweepPatches(&sweep))
+		cout << "Program failed to initialize sweep patches!" << endl;
+	float pixelsPerSegment = 8.f;
+
+	// the model keeps its own buffer so it is only uploaded when regenerated
+	Geometry modelGeometry;
+	QuantizedMesh modelMesh;
+	VertexLayout modelGeometryLayout = model_layout;
+	if (model_layout != LAYOUT_FLOAT && !InitializePackedVAO(&modelGeometry, model_layout))
+		cout << "Program failed to initialize model geometry!" << endl;
+
+
+	// headless frames are read back to disk a few frames behind
+	FrameCapture* capture = (headless && capturePrefix) ? new FrameCapture(fbWidth, fbHeight, capturePrefix) : 0;
+	int frames = 0;
+	auto startTime = std::chrono::steady_clock::now();
 
 	// run an event-triggered main loop
-	while (!glfwWindowShouldClose(window)) {
+	while (window ? !glfwWindowShouldClose(window) : !quit) {
+		input.beginFrame();
+		// headless runs stop after the replay, or after a fixed number of frames
+		if (!window && (input.finished() || (frameLimit > 0 && frames >= frameLimit)))
+			break;
+		vector<string> changedShaders;
+		if (watcher.poll(changedShaders))
+			ReloadPrograms(reloadable, changedShaders);
+
 		// clear screen to a dark grey colour
 		glClearColor(0.2f, 0.2f, 0.2f, 1.0f);
 		glClear(GL_COLOR_BUFFER_BIT);
 		if(clear) {
 			clear = false;
-			if(press == 1) {
-				points.clear();
-			} else if(press == 2) {
-				points2.clear();
-			} else if(press == 3) {
-				points3.clear();
+			InvalidateCurveLayer(&layer);
+			if(press >= 1 && press <= 3) {
+				curves[press-1]->clear();
+				grid.removeCurve(press-1);
+				model_stale = true;
+				if(dragged.curve == press-1) {
+					dragged = PointRef();
+					layer.dragCurve = -1;
+				}
 			}
 		}
 		
-		if(press == 1 && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-			double xpos, ypos;
-			glfwGetCursorPos(window, &xpos, &ypos);
-			points.push_back(vec2(xpos/(width/2)-1, -(ypos/(height/2)-1)));
-		}
-		if(press == 2 && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+		if(press >= 1 && press <= 3) {
 			double xpos, ypos;
-			glfwGetCursorPos(window, &xpos, &ypos);
-			points2.push_back(vec2(xpos/(width/2)-1, -(ypos/(height/2)-1)));
-		}
-		if(press == 3 && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
-			double xpos, ypos;
-			glfwGetCursorPos(window, &xpos, &ypos);
-			points3.push_back(vec2(xpos/(width/2)-1, -(ypos/(height/2)-1)));
+			input.cursorPos(&xpos, &ypos);
+			vec2 cursor(xpos/(width/2)-1, -(ypos/(height/2)-1));
+			vector<vec2> *curve = curves[press-1];
+			
+			if(input.mouseButton(GLFW_MOUSE_BUTTON_RIGHT) == GLFW_PRESS) {
+				//grab the closest point of the curves on screen, then follow the cursor
+				if(dragged.curve < 0) {
+					unsigned int mask = (press == 3) ? 4 : 3;
+					if(grid.nearest(cursor, pickRadius, mask, &dragged)) {
+						layer.dragCurve = dragged.curve;
+						layer.dragFirst = dragged.index > 0 ? dragged.index-1 : 0;
+						layer.dragLast = dragged.index+1;
+						InvalidateCurveLayer(&layer);
+					}
+				}
+				if(dragged.curve >= 0) {
+					vec2 &point = curves[dragged.curve]->at(dragged.index);
+					grid.move(dragged, point, cursor);
+					point = cursor;
+					model_stale = true;
+				}
+			} else if(dragged.curve >= 0) {
+				//put the finished span back into the layer
+				glBindFramebuffer(GL_FRAMEBUFFER, layer.framebuffer);
+				vector<vec3> rline;
+				get_open_curve(&rline, &colours, curves[dragged.curve], curve_colours[dragged.curve], layer.dragFirst, layer.dragLast);
+				LoadGeometry(&geometry, rline.data(), colours.data(), rline.size());
+				RenderScene(&geometry, program.id);
+				glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
+				dragged = PointRef();
+				layer.dragCurve = -1;
+			} else if(input.mouseButton(GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+				curve->push_back(cursor);
+				grid.insert(PointRef(press-1, curve->size()-1), cursor);
+				model_stale = true;
+			}
 		}
 		
 		//create the model
 		if(render_model) {
 			render_model = false;
-			pointsm.clear();
-			colours.clear();
-			vector<vector<vec3>> model_points;
-			
-			/*float foo = abs(points2[0].x - points2[points2.size()-1].x);
-			float bar = abs(points2[0].y - points2[points2.size()-1].y);
-			float baz = atan(bar/foo);
-			mat2 rotate = mat2(vec2(cos(baz), -sin(baz)), vec2(sin(baz), cos(baz)));*/
-			
-			vector<vec2> curve21;
-			vector<vec2> curve22;
-			vector<vec2> curve23;
+			model_stale = false;
 			vector<vec2> curve1;
 			vector<vec2> curve2;
 			vector<vec2> curve3;
-			
-			/*points.erase(points.begin());
-			points.pop_back();
-			points2.erase(points2.begin());
-			points2.pop_back();
-			points3.erase(points3.begin());
-			points3.pop_back();*/
-			
-			spline(&curve21, &points);
-			spline(&curve22, &points2);
-			spline(&curve23, &points3);
-			smooth(&curve1, &curve21);
-			smooth(&curve2, &curve22);
-			smooth(&curve3, &curve23);
-			
-			
-			unsigned int itt = std::min(curve1.size(), curve2.size());
-			for(unsigned int i = 0; i < itt; i++) {
-				vector<vec3> tmp;
-				float scale = abs(curve1[i].x - curve2[i].x) + abs(curve1[i].y - curve2[i].y);
-				for(unsigned int j = 0; j < curve3.size(); j++) {
-					float foo = (float)j/((float)curve3.size()-1);
-					//curve3[j] = curve3[j]*rotate;
-					vec3 point1 = vec3();
-					point1.x = curve3[j].x*scale + ((1-foo)*curve1[i].x + (foo)*curve2[i].x);
-					point1.y = 2*((1-foo)*curve1[i].y + (foo)*curve2[i].y);
-					point1.z = 2*(curve3[j].y*scale - ((curve3[0].y*scale*(1-foo)) + (curve3[curve3.size()-1].y*scale*(foo))));
-					tmp.push_back(point1);
-				}
-				model_points.push_back(tmp);
+			GenerateModelCurves(&points, &points2, &points3, model_rows, &curve1, &curve2, &curve3);
+			LoadSweepPatches(&sweep, curve1, curve2, curve3);
+			BuildSurfaceGrid(&surface, curve1, curve2, curve3);
+			TriangulateSurface(&pointsm, &colours, surface, pm_colour);
+			relayout = true;
+		}
+		
+		if(export_format >= 0) {
+			const char* names[3] = {"model.stl", "model.ply", "model.obj"};
+			//after a curve edit the surface no longer matches what is on screen
+			if(surface.triangles() == 0 || model_stale) {
+				cout << "Nothing to export, press 4 to generate the model first" << endl;
+			} else if(ExportSurface(surface, (ExportFormat)export_format, names[export_format])) {
+				cout << "Exported " << surface.triangles() << " triangles to " << names[export_format] << endl;
+			} else {
+				cout << "Failed to export " << names[export_format] << endl;
 			}
-			for(int i = itt-1; i >= 0; i--) {
-				vector<vec3> tmp;
-				float scale = abs(curve1[i].x - curve2[i].x) + abs(curve1[i].y - curve2[i].y);
-				for(unsigned int j = 0; j < curve3.size(); j++) {
-					float foo = (float)j/((float)curve3.size()-1);
-					vec3 point1 = vec3();
-					point1.x = curve3[j].x*scale + ((1-foo)*curve1[i].x + (foo)*curve2[i].x);
-					point1.y = 2*((1-foo)*curve1[i].y + (foo)*curve2[i].y);
-					point1.z = -2*(curve3[j].y*scale - ((curve3[0].y*scale*(1-foo)) + (curve3[curve3.size()-1].y*scale*(foo))));
-					tmp.push_back(point1);
+			export_format = -1;
+		}
+		
+		if(save_project) {
+			save_project = false;
+			//a mesh reopened from a project was never unpacked, quantize it again to keep it cached
+			if(!model_stale && model_layout != LAYOUT_FLOAT && modelMesh.vertices.empty() && !pointsm.empty())
+				QuantizeMesh(&modelMesh, pointsm, model_layout);
+			ProjectData project;
+			for(int c = 0; c < 3; c++)
+				project.curves[c] = curves[c];
+			project.modelRows = model_rows;
+			//a model older than the curves is left out, opening the file regenerates it
+			project.surface = model_stale ? 0 : &surface;
+			project.mesh = (!model_stale && model_layout != LAYOUT_FLOAT && surface.triangles()) ? &modelMesh : 0;
+			if(SaveProject(project_path, project))
+				cout << "Saved " << project_path << endl;
+			else
+				cout << "Failed to save " << project_path << endl;
+		}
+		
+		if(load_project) {
+			load_project = false;
+			ProjectFile project;
+			if(!project.open(project_path)) {
+				cout << "Failed to open project " << project_path << endl;
+			} else {
+				const ProjectHeader* header = project.header();
+				for(int c = 0; c < 3; c++) {
+					unsigned int count;
+					const vec2* curve = project.curve(c, &count);
+					curves[c]->assign(curve, curve + count);
+					grid.removeCurve(c);
+					for(unsigned int i = 0; i < count; i++)
+						grid.insert(PointRef(c, i), curve[i]);
 				}
-				model_points.push_back(tmp);
-			}
-			
-			//make points into triangles
-			for(unsigned int i = 0; i < model_points.size()-1; i++) {
-				for(unsigned int j = 0; j < model_points[i].size()-1; j++) {
-					//cout << model_points[i][j].x << " " << model_points[i][j].y << " " << model_points[i][j].z << endl;
-					pointsm.push_back(model_points[i][j]);
-					pointsm.push_back(model_points[i][j+1]);
-					pointsm.push_back(model_points[i+1][j]);
-					
-					pointsm.push_back(model_points[i+1][j]);
-					pointsm.push_back(model_points[i][j+1]);
-					pointsm.push_back(model_points[i+1][j+1]);
+				dragged = PointRef();
+				layer.dragCurve = -1;
+				InvalidateCurveLayer(&layer);
+				model_rows = header->modelRows;
+				
+				surface = SurfaceGrid();
+				pointsm.clear();
+				modelMesh.vertices.clear();
+				model_stale = !project.surface();
+				if(press == 4) render_model = model_stale;
+				if(project.surface()) {
+					surface.rows = header->surfaceRows;
+					surface.columns = header->surfaceColumns;
+					surface.points.assign(project.surface(), project.surface() + header->surface.count);
+					TriangulateSurface(&pointsm, &colours, surface, pm_colour);
+					//the sweep patches only need the curves, not the surface
+					vector<vec2> curve1, curve2, curve3;
+					GenerateModelCurves(&points, &points2, &points3, model_rows, &curve1, &curve2, &curve3);
+					LoadSweepPatches(&sweep, curve1, curve2, curve3);
 					
-					colours.push_back(pm_colour);
-					colours.push_back(pm_colour);
-					colours.push_back(pm_colour);
-					colours.push_back(pm_colour);
-					colours.push_back(pm_colour);
-					colours.push_back(pm_colour);
+					//a cached mesh in the current layout is uploaded straight from the mapping
+					unsigned int count;
+					const PackedVertex* mesh = project.mesh(&count);
+					if(mesh && header->meshLayout == (uint32_t)model_layout && model_layout == modelGeometryLayout) {
+						modelMesh.layout = model_layout;
+						memcpy(&modelMesh.dequantize[0][0], header->dequantize, sizeof(header->dequantize));
+						LoadPackedGeometry(&modelGeometry, mesh, count);
+					} else {
+						relayout = true;
+					}
 				}
+				cout << "Opened " << project_path << endl;
 			}
 		}
 		
-		if(press == 1 || press == 2) {
-			vector<vec3> rline1, rline2;
-			get_open_curve(&rline1, &colours, &points, p1_colour);
-			LoadGeometry(&geometry, rline1.data(), colours.data(), rline1.size());
-			RenderScene(&geometry, program);
-			get_open_curve(&rline2, &colours, &points2, p2_colour);
-			LoadGeometry(&geometry, rline2.data(), colours.data(), rline2.size());
-			// call function to draw our scene
-			RenderScene(&geometry, program);
-		} else if(press == 3) {
-			vector<vec3> render_line;
-			get_open_curve(&render_line, &colours, &points3, p3_colour);
-			LoadGeometry(&geometry, render_line.data(), colours.data(), render_line.size());
-			// call function to draw our scene
-			RenderScene(&geometry, program);
+		if(relayout) {
+			relayout = false;
+			if(model_layout != LAYOUT_FLOAT) {
+				//the attribute formats live in the VAO, rebuild it for a new layout
+				if(model_layout != modelGeometryLayout) {
+					DestroyGeometry(&modelGeometry);
+					modelGeometry = Geometry();
+					InitializePackedVAO(&modelGeometry, model_layout);
+					modelGeometryLayout = model_layout;
+				}
+				QuantizeMesh(&modelMesh, pointsm, model_layout);
+				LoadPackedGeometry(&modelGeometry, modelMesh);
+			}
+		}
+		
+		if(press >= 1 && press <= 3) {
+			//curves 1 and 2 are edited together, the bump curve on its own
+			int first = (press == 3) ? 2 : 0;
+			int last = (press == 3) ? 2 : 1;
+			int active = press-1;
+			bool drawing = input.mouseButton(GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS && dragged.curve < 0;
+			if(layer.mode != press) {
+				layer.mode = press;
+				InvalidateCurveLayer(&layer);
+			}
+			
+			glBindFramebuffer(GL_FRAMEBUFFER, layer.framebuffer);
+			if(!layer.valid) {
+				glClear(GL_COLOR_BUFFER_BIT);
+				layer.cached[0] = layer.cached[1] = layer.cached[2] = 0;
+				layer.valid = true;
+			}
+			//add whatever is not in the layer yet, except the stroke being drawn
+			for(int c = first; c <= last; c++) {
+				if(c == active && drawing) continue;
+				if(c == layer.dragCurve) {
+					//everything but the dragged span, only once per drag
+					if(layer.cached[c] == 0) {
+						vector<vec3> rline;
+						get_open_curve(&rline, &colours, curves[c], curve_colours[c], 0, layer.dragFirst);
+						LoadGeometry(&geometry, rline.data(), colours.data(), rline.size());
+						RenderScene(&geometry, program.id);
+						get_open_curve(&rline, &colours, curves[c], curve_colours[c], layer.dragLast);
+						LoadGeometry(&geometry, rline.data(), colours.data(), rline.size());
+						RenderScene(&geometry, program.id);
+						layer.cached[c] = curves[c]->size();
+					}
+					continue;
+				}
+				if(curves[c]->size() > layer.cached[c]) {
+					vector<vec3> rline;
+					get_open_curve(&rline, &colours, curves[c], curve_colours[c], layer.cached[c] > 0 ? layer.cached[c]-1 : 0);
+					LoadGeometry(&geometry, rline.data(), colours.data(), rline.size());
+					RenderScene(&geometry, program.id);
+					layer.cached[c] = curves[c]->size();
+				}
+			}
+			glBindFramebuffer(GL_FRAMEBUFFER, screen_framebuffer);
+			CompositeCurveLayer(&layer, &programLayer);
+			
+			//the live part of the active stroke goes on top
+			if(curves[active]->size() > layer.cached[active]) {
+				vector<vec3> render_line;
+				get_open_curve(&render_line, &colours, curves[active], curve_colours[active], layer.cached[active] > 0 ? layer.cached[active]-1 : 0);
+				LoadGeometry(&geometry, render_line.data(), colours.data(), render_line.size());
+				// call function to draw our scene
+				RenderScene(&geometry, program.id);
+			}
+			//as is the span around a dragged point
+			if(layer.dragCurve >= 0) {
+				vector<vec3> render_line;
+				get_open_curve(&render_line, &colours, curves[layer.dragCurve], curve_colours[layer.dragCurve], layer.dragFirst, layer.dragLast);
+				LoadGeometry(&geometry, render_line.data(), colours.data(), render_line.size());
+				RenderScene(&geometry, program.id);
+			}
 		} else if(press == 4) {
 			////////////////////////
 			//Camera interaction
@@ -591,51 +1367,87 @@ int main(int argc, char *argv[])
 			//Translation
 			vec3 movement(0.f);
 			
-			if(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+			if(input.key(GLFW_KEY_W) == GLFW_PRESS)
 				movement.z += 1.f;
-			if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+			if(input.key(GLFW_KEY_S) == GLFW_PRESS)
 				movement.z -= 1.f;
-			if(glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+			if(input.key(GLFW_KEY_D) == GLFW_PRESS)
 				movement.x += 1.f;
-			if(glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+			if(input.key(GLFW_KEY_A) == GLFW_PRESS)
 				movement.x -= 1.f;
-			if(glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
+			if(input.key(GLFW_KEY_SPACE) == GLFW_PRESS)
 				movement.y += 1.f;
-			if(glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
+			if(input.key(GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
 				movement.y -= 1.f;
 			cam.move(movement*movementSpeed);
 			light = cam.pos;
 			
 			//Rotation
 			double xpos, ypos;
-			glfwGetCursorPos(window, &xpos, &ypos);
+			input.cursorPos(&xpos, &ypos);
 			vec2 cursorPos(xpos, ypos);
 			vec2 cursorChange = cursorPos - lastCursorPos;
 			lastCursorPos = cursorPos;
 			
-			if(glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
+			if(input.mouseButton(GLFW_MOUSE_BUTTON_LEFT) == GLFW_PRESS) {
 				cam.rotateHorizontal(-cursorChange.x*cursorSensitivity);
 				cam.rotateVertical(-cursorChange.y*cursorSensitivity);
 			}
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-			glUseProgram(program3d);
-			glUniform3fv(cameraGL, 1, &(cam.pos.x));
-			glUniform3fv(lightGL, 1, &(light.x));
-			LoadGeometry(&geometry, pointsm.data(), colours.data(), pointsm.size());
-			RenderScene(&geometry, program3d, vec3(1, 0, 0), &cam, perspectiveMatrix, GL_TRIANGLES);
+			FrameUniforms frame;
+			frame.modelViewProjection = perspectiveMatrix*cam.viewMatrix();
+			frame.cameraPos = vec4(cam.pos, 1);
+			frame.light = vec4(light, 1);
+			frame.viewport = vec4(fbWidth, fbHeight, 0, 0);
+			UpdateFrameUniforms(frameUniformBuffer, frame);
+			if(tessellate) {
+				RenderSweepPatches(&sweep, &programTess, pm_colour, pixelsPerSegment);
+			} else if(model_layout != LAYOUT_FLOAT) {
+				RenderPackedScene(&modelGeometry, &programPacked, modelMesh, pm_colour);
+			} else {
+				LoadGeometry(&geometry, pointsm.data(), colours.data(), pointsm.size());
+				RenderScene(&geometry, &program3d, vec3(1, 0, 0), GL_TRIANGLES);
+			}
 		}
 
-		glfwSwapBuffers(window);
+		frames++;
+		if (window) {
+			glfwSwapBuffers(window);
 
-		glfwPollEvents();
+			glfwPollEvents();
+		} else if (capture) {
+			capture->capture(target.framebuffer);
+		}
+	}
+
+	if (headless) {
+		glFinish();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		cout << "Rendered " << frames << " frames in " << seconds << "s (" << frames/seconds << " fps)" << endl;
+	}
+	if (capture) {
+		capture->finish();
+		delete capture;
 	}
 
 	// clean up allocated resources before exit
 	DestroyGeometry(&geometry);
+	DestroyCurveLayer(&layer);
+	DestroySweepPatches(&sweep);
+	DestroyGeometry(&modelGeometry);
 	glUseProgram(0);
-	glDeleteProgram(program);
-	glfwDestroyWindow(window);
-	glfwTerminate();
+	glDeleteProgram(program.id);
+	glDeleteProgram(program3d.id);
+	glDeleteProgram(programLayer.id);
+	glDeleteProgram(programTess.id);
+	glDeleteProgram(programPacked.id);
+	glDeleteBuffers(1, &frameUniformBuffer);
+	if (window) {
+		glfwDestroyWindow(window);
+		glfwTerminate();
+	} else {
+		DestroyOffscreenTarget(&target);
+	}
 
 	cout << "Goodbye!" << endl;
 	return 0;
@@ -745,6 +1557,9 @@ GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader)
 	if (vertexShader)   glAttachShader(programObject, vertexShader);
 	if (fragmentShader) glAttachShader(programObject, fragmentShader);
 
+	// ask the driver to keep the binary around for the program cache
+	if (programCache) programCache->retrievable(programObject);
+
 	// try linking the program with given attachments
 	glLinkProgram(programObject);
 
@@ -774,6 +1589,43 @@ GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader, GLuint geoShader)
 	if (fragmentShader) glAttachShader(programObject, fragmentShader);
 	if (geoShader) glAttachShader(programObject, geoShader);
 
+	// ask the driver to keep the binary around for the program cache
+	if (programCache) programCache->retrievable(programObject);
+
+	// try linking the program with given attachments
+	glLinkProgram(programObject);
+
+	// retrieve link status
+	GLint status;
+	glGetProgramiv(programObject, GL_LINK_STATUS, &status);
+	if (status == GL_FALSE)
+	{
+		GLint length;
+		glGetProgramiv(programObject, GL_INFO_LOG_LENGTH, &length);
+		string info(length, ' ');
+		glGetProgramInfoLog(programObject, info.length(), &length, &info[0]);
+		cout << "ERROR linking shader program:" << endl;
+		cout << info << endl;
+	}
+
+	return programObject;
+}
+
+GLuint LinkProgram(GLuint vertexShader, GLuint fragmentShader, GLuint geoShader, GLuint tessControlShader, GLuint tessEvalShader)
+{
+	// allocate program object name
+	GLuint programObject = glCreateProgram();
+
+	// attach provided shader objects to this program
+	if (vertexShader)   glAttachShader(programObject, vertexShader);
+	if (fragmentShader) glAttachShader(programObject, fragmentShader);
+	if (geoShader) glAttachShader(programObject, geoShader);
+	if (tessControlShader) glAttachShader(programObject, tessControlShader);
+	if (tessEvalShader) glAttachShader(programObject, tessEvalShader);
+
+	// ask the driver to keep the binary around for the program cache
+	if (programCache) programCache->retrievable(programObject);
+
 	// try linking the program with given attachments
 	glLinkProgram(programObject);
 
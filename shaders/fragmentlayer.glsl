@@ -0,0 +1,16 @@
+// ==========================================================================
+// Fragment program for compositing the cached curve layer
+// ==========================================================================
+#version 410
+
+uniform sampler2D layer;
+
+in vec2 TexCoord;
+
+out vec4 FragmentColour;
+
+void main(void)
+{
+	// the layer is opaque, it already contains the background colour
+	FragmentColour = vec4(texture(layer, TexCoord).rgb, 1);
+}
@@ -1,5 +1,4 @@
 #version 410
-#extension GL_EXT_geometry_shader4 : enable
 layout(triangles) in;
 layout(triangle_strip, max_vertices = 3) out;
 
@@ -27,8 +26,8 @@ void main() {
 	vec3 N = cross(V1, V0);
 	normal = normalize(N);
 	
-	for(int i = 0; i < gl_VerticesIn; i++) {
-		gl_Position = gl_PositionIn[i];
+	for(int i = 0; i < gl_in.length(); i++) {
+		gl_Position = gl_in[i].gl_Position;
 		EmitVertex();
 	}
 	EndPrimitive();
@@ -0,0 +1,93 @@
+// ==========================================================================
+// Tessellation control program for the GPU evaluated sweep surface
+// ==========================================================================
+#version 410
+
+layout(vertices = 1) out;
+
+layout(std140) uniform FrameData {
+	mat4 modelViewProjection;
+	vec4 cameraPos;
+	vec4 light;
+	vec4 viewport;	// framebuffer width and height in xy
+};
+
+// number of patches along the rows and along the profile
+uniform ivec2 patchGrid;
+// target on-screen length of one tessellated edge
+uniform float pixelsPerSegment;
+
+// corners of this patch in (row, profile) parameter space
+patch out vec2 patchMin;
+patch out vec2 patchMax;
+
+// keep in sync with tesseval.glsl
+// rows hold base curve 1 in xy and base curve 2 in zw, profile holds the bump curve
+uniform samplerBuffer rows;
+uniform samplerBuffer profile;
+
+// point on the surface for an integer row and a position t along the profile;
+// rows run down the base curves and back up with the bump mirrored
+vec3 sweepRow(int r, float t)
+{
+	int rowCount = textureSize(rows);
+	int profileCount = textureSize(profile);
+	int i = r < rowCount ? r : 2*rowCount-1-r;
+	float side = r < rowCount ? 1.0 : -1.0;
+
+	vec4 base = texelFetch(rows, i);
+	float scale = abs(base.x - base.z) + abs(base.y - base.w);
+
+	float p = t*float(profileCount-1);
+	int j = min(int(p), profileCount-2);
+	vec2 bump = mix(texelFetch(profile, j).xy, texelFetch(profile, j+1).xy, p - float(j));
+	float first = texelFetch(profile, 0).y*scale;
+	float last = texelFetch(profile, profileCount-1).y*scale;
+
+	vec3 point;
+	point.x = bump.x*scale + mix(base.x, base.z, t);
+	point.y = 2*mix(base.y, base.w, t);
+	point.z = side*2*(bump.y*scale - mix(first, last, t));
+	return point;
+}
+
+// r is continuous in [0, 2*rows-1], t in [0, 1]
+vec3 sweep(float r, float t)
+{
+	int row = min(int(r), 2*textureSize(rows)-2);
+	return mix(sweepRow(row, t), sweepRow(row+1, t), r - float(row));
+}
+
+vec2 toScreen(vec3 point)
+{
+	vec4 clip = modelViewProjection*vec4(point, 1.0);
+	return clip.xy/max(clip.w, 0.0001)*0.5*viewport.xy;
+}
+
+float edgeLevel(vec2 a, vec2 b)
+{
+	return clamp(distance(a, b)/pixelsPerSegment, 1.0, gl_MaxTessGenLevel);
+}
+
+void main()
+{
+	ivec2 cell = ivec2(gl_PrimitiveID % patchGrid.x, gl_PrimitiveID / patchGrid.x);
+	vec2 span = vec2(2*textureSize(rows)-1, 1.0);
+	vec2 lo = span*vec2(cell)/vec2(patchGrid);
+	vec2 hi = span*vec2(cell+1)/vec2(patchGrid);
+	patchMin = lo;
+	patchMax = hi;
+
+	// levels only depend on the shared edge, so neighbouring patches match
+	vec2 c00 = toScreen(sweep(lo.x, lo.y));
+	vec2 c10 = toScreen(sweep(hi.x, lo.y));
+	vec2 c01 = toScreen(sweep(lo.x, hi.y));
+	vec2 c11 = toScreen(sweep(hi.x, hi.y));
+
+	gl_TessLevelOuter[0] = edgeLevel(c00, c01);
+	gl_TessLevelOuter[1] = edgeLevel(c00, c10);
+	gl_TessLevelOuter[2] = edgeLevel(c10, c11);
+	gl_TessLevelOuter[3] = edgeLevel(c01, c11);
+	gl_TessLevelInner[0] = max(gl_TessLevelOuter[1], gl_TessLevelOuter[3]);
+	gl_TessLevelInner[1] = max(gl_TessLevelOuter[0], gl_TessLevelOuter[2]);
+}
@@ -0,0 +1,72 @@
+// ==========================================================================
+// Tessellation evaluation program for the GPU evaluated sweep surface
+// ==========================================================================
+#version 410
+
+// clockwise gives the same facing as the triangles built on the CPU
+layout(quads, equal_spacing, cw) in;
+
+layout(std140) uniform FrameData {
+	mat4 modelViewProjection;
+	vec4 cameraPos;
+	vec4 light;
+	vec4 viewport;	// framebuffer width and height in xy
+};
+
+patch in vec2 patchMin;
+patch in vec2 patchMax;
+
+uniform vec3 surfaceColour;
+
+// same outputs as vertex3d.glsl so geometry3d.glsl can follow
+out vec3 colour;
+out vec3 light_Vec;
+out vec3 camera_Vec;
+
+// keep in sync with tesscontrol.glsl
+// rows hold base curve 1 in xy and base curve 2 in zw, profile holds the bump curve
+uniform samplerBuffer rows;
+uniform samplerBuffer profile;
+
+// point on the surface for an integer row and a position t along the profile;
+// rows run down the base curves and back up with the bump mirrored
+vec3 sweepRow(int r, float t)
+{
+	int rowCount = textureSize(rows);
+	int profileCount = textureSize(profile);
+	int i = r < rowCount ? r : 2*rowCount-1-r;
+	float side = r < rowCount ? 1.0 : -1.0;
+
+	vec4 base = texelFetch(rows, i);
+	float scale = abs(base.x - base.z) + abs(base.y - base.w);
+
+	float p = t*float(profileCount-1);
+	int j = min(int(p), profileCount-2);
+	vec2 bump = mix(texelFetch(profile, j).xy, texelFetch(profile, j+1).xy, p - float(j));
+	float first = texelFetch(profile, 0).y*scale;
+	float last = texelFetch(profile, profileCount-1).y*scale;
+
+	vec3 point;
+	point.x = bump.x*scale + mix(base.x, base.z, t);
+	point.y = 2*mix(base.y, base.w, t);
+	point.z = side*2*(bump.y*scale - mix(first, last, t));
+	return point;
+}
+
+// r is continuous in [0, 2*rows-1], t in [0, 1]
+vec3 sweep(float r, float t)
+{
+	int row = min(int(r), 2*textureSize(rows)-2);
+	return mix(sweepRow(row, t), sweepRow(row+1, t), r - float(row));
+}
+
+void main()
+{
+	vec2 param = mix(patchMin, patchMax, gl_TessCoord.xy);
+	vec3 position = sweep(param.x, param.y);
+
+	gl_Position = modelViewProjection*vec4(position, 1.0);
+	colour = surfaceColour;
+	light_Vec = light.xyz - position;
+	camera_Vec = cameraPos.xyz - position;
+}
@@ -11,9 +11,13 @@
 layout(location = 0) in vec3 VertexPosition;
 layout(location = 1) in vec3 VertexColour;
 
-uniform mat4 modelViewProjection;
-uniform vec3 light;
-uniform vec3 cameraPos;
+// per-frame data shared by all programs, updated once per frame
+layout(std140) uniform FrameData {
+	mat4 modelViewProjection;
+	vec4 cameraPos;
+	vec4 light;
+	vec4 viewport;	// framebuffer width and height in xy
+};
 out vec3 colour;
 
 //out vec3 normal;
@@ -32,6 +36,6 @@ void main()
 	normal.y = (U.z*V.x) - (U.x*V.z);
 	normal.z = (U.x*V.y) - (U.y*V.x);
 	normal = normalize(normal);*/
-    light_Vec = light - VertexPosition;
-    camera_Vec = cameraPos - VertexPosition;
+    light_Vec = light.xyz - VertexPosition;
+    camera_Vec = cameraPos.xyz - VertexPosition;
 }
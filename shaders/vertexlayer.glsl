@@ -0,0 +1,15 @@
+// ==========================================================================
+// Vertex program for compositing the cached curve layer
+// ==========================================================================
+#version 410
+
+// texture coordinate for the fragment stage
+out vec2 TexCoord;
+
+void main()
+{
+	// full-screen quad generated from the vertex index, no buffers needed
+	vec2 corner = vec2(gl_VertexID & 1, gl_VertexID >> 1);
+	TexCoord = corner;
+	gl_Position = vec4(corner*2.0 - 1.0, 0.0, 1.0);
+}
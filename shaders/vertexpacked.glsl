@@ -0,0 +1,47 @@
+// ==========================================================================
+// Vertex program for the quantized model mesh
+// ==========================================================================
+#version 410
+
+// integer positions relative to the mesh bounds and an encoded normal, see
+// InitializePackedVAO() in the main program
+layout(location = 0) in vec3 VertexPosition;
+layout(location = 1) in vec4 VertexNormal;
+
+layout(std140) uniform FrameData {
+	mat4 modelViewProjection;
+	vec4 cameraPos;
+	vec4 light;
+	vec4 viewport;	// framebuffer width and height in xy
+};
+
+// dequantizes the positions into model space
+uniform mat4 model;
+// 1 if the normal is octahedral in xy, 0 if it is xyz
+uniform int octahedral;
+uniform vec3 surfaceColour;
+
+// same outputs as geometry3d.glsl so fragment3d.glsl can follow
+out vec3 normal;
+out vec3 frag_colour;
+out vec3 lightVec;
+out vec3 cameraVec;
+
+vec3 decodeOctahedral(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	if (n.z < 0.0)
+		n.xy = (1.0 - abs(n.yx))*vec2(e.x >= 0.0 ? 1.0 : -1.0, e.y >= 0.0 ? 1.0 : -1.0);
+	return normalize(n);
+}
+
+void main()
+{
+	vec3 position = (model*vec4(VertexPosition, 1.0)).xyz;
+	gl_Position = modelViewProjection*vec4(position, 1.0);
+
+	normal = octahedral == 1 ? decodeOctahedral(VertexNormal.xy/32767.0) : normalize(VertexNormal.xyz);
+	frag_colour = surfaceColour;
+	lightVec = light.xyz - position;
+	cameraVec = cameraPos.xyz - position;
+}
@@ -0,0 +1,11 @@
+// ==========================================================================
+// Vertex program for the GPU evaluated sweep surface
+// ==========================================================================
+#version 410
+
+// each vertex only stands for one patch of the surface, the patch is placed
+// from gl_PrimitiveID in the control stage so there are no attributes
+void main()
+{
+	gl_Position = vec4(0.0);
+}